@@ -29,6 +29,23 @@ function(sol_cc_library)
   endif()
 endfunction()
 
+function(sol_cc_binary)
+  cmake_parse_arguments(
+    PARSE_ARGV 0
+    arg
+    ""        # No options
+    "NAME"    # Single-value parameter: the name of the executable
+    "SRCS;DEPS"  # Multi-value parameters: sources and dependencies of the executable
+  )
+
+  # Create the executable in the 'bin/' directory
+  add_executable(${arg_NAME} ${arg_SRCS})
+  set_target_properties(${arg_NAME} PROPERTIES
+    RUNTIME_OUTPUT_DIRECTORY ${CMAKE_BINARY_DIR}/bin
+  )
+  target_link_libraries(${arg_NAME} ${arg_DEPS})
+endfunction()
+
 function(sol_cc_gtest)
   # Check if testing is disabled
   if(DISABLE_TESTING)
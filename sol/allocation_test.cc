@@ -0,0 +1,154 @@
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sol/sql_constructor_builder.h"
+#include "sol/sqlite_file.h"
+#include "sol/utils/allocation_counter.h"
+
+SOL_DEFINE_COUNTING_ALLOCATOR();
+
+using namespace sqliteol;
+using namespace sqliteol::utils;
+using namespace testing;
+
+/*
+ * Upper bounds on heap allocations per row of the hot paths. A failure here means a
+ * change added allocations to a per-row loop; tighten the bounds when a change
+ * removes some.
+ */
+
+namespace {
+
+struct Row {
+  int id;
+  std::string name;
+  double value;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("AllocationRow")
+        .AddColumn("id", &id)
+        .AddColumn("name", &name)
+        .AddColumn("value", &value)
+        .Build();
+  }
+};
+
+constexpr size_t kRows = 1000;
+
+class AllocationTest : public Test {
+ protected:
+  void SetUp() override {
+    // The default loggers format every statement; keep them out of the counts.
+    auto ignore = [](const std::string&) {};
+    Logger::getInstance().SetLogFunctions({ignore, ignore, ignore, ignore, ignore});
+
+    // One directory per test, so tests running in parallel do not share a database.
+    dir_ = std::filesystem::temp_directory_path() /
+           (std::string("AllocationTest.") +
+            UnitTest::GetInstance()->current_test_info()->name());
+    std::filesystem::remove_all(dir_);
+    std::filesystem::create_directory(dir_);
+    db_file_ = std::make_unique<SqliteFile>(
+        dir_ / "test.db", ConnectionOptions{.mode = ConnectionMode::kCached});
+    db_file_->EnsureTable<Row>();
+    rows_.assign(kRows, Row{42, "a name longer than the small string buffer", 1.5});
+  }
+
+  void TearDown() override {
+    db_file_.reset();
+    std::filesystem::remove_all(dir_);
+  }
+
+  std::filesystem::path dir_;
+  std::unique_ptr<SqliteFile> db_file_;
+  std::vector<Row> rows_;
+};
+
+TEST_F(AllocationTest, SerializationTraits) {
+  std::string long_text(100, 'x');
+  double sink           = 0;  // Keeps the conversions from being optimized away
+  AllocationStats stats = CountAllocations([&] {
+    for (size_t i = 0; i < kRows; ++i) {
+      sink += ToDataBaseString(static_cast<int>(i)).size();
+      sink += FromDataBaseString<int64_t>("1234567890");
+      sink += FromDataBaseString<double>("3.25");
+    }
+  });
+  EXPECT_EQ(stats.allocations, 0);
+
+  stats = CountAllocations([&] {
+    for (size_t i = 0; i < kRows; ++i) {
+      sink += FromDataBaseString<std::string>(long_text).size();
+    }
+  });
+  EXPECT_LE(stats.allocations, kRows);
+  EXPECT_GT(sink, 0);
+}
+
+TEST_F(AllocationTest, BuildOfCachedTable) {
+  Row row;
+  row.sql_constructor();  // The first Build creates the TableInfo
+  size_t sink           = 0;
+  AllocationStats stats = CountAllocations([&] {
+    for (size_t i = 0; i < kRows; ++i) {
+      sink += row.sql_constructor().GetColumnNames().size();
+    }
+  });
+  EXPECT_EQ(stats.allocations, 0);
+  EXPECT_EQ(sink, 3 * kRows);
+}
+
+TEST_F(AllocationTest, Insert) {
+  db_file_->Insert(rows_.front());  // Opens the cached writer
+  AllocationStats stats = CountAllocations([&] {
+    for (size_t i = 0; i < 100; ++i) {
+      db_file_->Insert(rows_[i]);
+    }
+  });
+  EXPECT_LE(stats.allocations, 2 * 100);
+}
+
+TEST_F(AllocationTest, InsertRows) {
+  db_file_->InsertRows(rows_);  // Grows the thread's SQL buffer
+  AllocationStats stats = CountAllocations([&] { db_file_->InsertRows(rows_); });
+  // The statement text is built in the reused buffer: a constant per batch.
+  EXPECT_LE(stats.allocations, 8);
+}
+
+TEST_F(AllocationTest, GetTable) {
+  db_file_->InsertRows(rows_);
+  db_file_->GetTable<Row>();  // Opens the cached reader
+  AllocationStats stats = CountAllocations([&] {
+    EXPECT_EQ(db_file_->GetTable<Row>().size(), kRows);
+  });
+  EXPECT_LE(stats.allocations, 3 * kRows);
+}
+
+TEST_F(AllocationTest, ScopesNest) {
+  AllocationStats inner;
+  AllocationStats outer = CountAllocations([&] {
+    auto value = std::make_unique<int>(1);
+    inner      = CountAllocations([] { std::make_unique<int>(2); });
+  });
+  EXPECT_EQ(outer.allocations, 1);
+  EXPECT_EQ(inner.allocations, 1);
+  EXPECT_EQ(inner.bytes, sizeof(int));
+
+  struct alignas(64) Aligned {
+    char bytes[64];
+  };
+  AllocationStats aligned = CountAllocations([] { std::make_unique<Aligned>(); });
+  EXPECT_EQ(aligned.allocations, 1);
+  EXPECT_EQ(aligned.bytes, sizeof(Aligned));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
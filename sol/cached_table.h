@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <typeinfo>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sol/sqlite_file.h"
+
+namespace sqliteol {
+
+/**
+ * @class CachedTable
+ * @brief Read-through LRU cache of T rows keyed by the table's primary key.
+ *
+ * @details Get() serves hot keys from a bounded, sharded LRU of decoded rows and falls
+ *          back to SqliteFile::Get (a cached prepared `SELECT ... WHERE pk = ?`) on a
+ *          miss. Keys written through the SqliteFile's own write paths are
+ *          invalidated write-through, those made in a transaction once it has ended;
+ *          writes made outside the library (raw SQL, other processes) are not seen,
+ *          call Invalidate or Clear for those. Inside a transaction Get bypasses the
+ *          cache. Key must be
+ *          the C++ type of the primary key column. All methods are thread-safe.
+ *
+ * Example usage:
+ *   CachedTable<User, int64_t> users(db_file, {.capacity = 10000});
+ *   std::optional<User> user = users.Get(42);
+ */
+template <HasSqliteHelper T, typename Key>
+class CachedTable {
+ public:
+  struct Options {
+    size_t capacity = 1024;
+    size_t shards   = 16;
+  };
+
+  struct Stats {
+    uint64_t hits          = 0;
+    uint64_t misses        = 0;
+    uint64_t evictions     = 0;
+    uint64_t invalidations = 0;
+
+    inline double HitRate() const {
+      uint64_t lookups = hits + misses;
+      return lookups == 0 ? 0.0 : static_cast<double>(hits) / lookups;
+    }
+  };
+
+  inline CachedTable(SqliteFile& file, const Options& options = {})
+      : file_(file), shards_(std::max<size_t>(options.shards, 1)) {
+    size_t shard_count    = shards_.size();
+    size_t shard_capacity = (std::max<size_t>(options.capacity, 1) + shard_count - 1) /
+                            shard_count;
+    for (auto& shard : shards_) {
+      shard.capacity = shard_capacity;
+    }
+
+    auto& helper = GetDefaultSqliteHelper<T>();
+    if (!helper.HasPrimaryKey() || *helper.GetPrimaryKeyType() != typeid(Key)) {
+      throw std::runtime_error(utils::StrCombine(
+          "CachedTable key type does not match the primary key of ",
+          helper.GetTableName()));
+    }
+    subscription_ = file_.OnKeyWritten<T>([this](const void* key) {
+      if (key == nullptr) {
+        Clear();
+      } else {
+        Invalidate(*static_cast<const Key*>(key));
+      }
+    });
+  }
+
+  CachedTable(const CachedTable&)            = delete;
+  CachedTable& operator=(const CachedTable&) = delete;
+
+  // Returns the row with primary key `key`, or std::nullopt if there is none.
+  inline std::optional<T> Get(const Key& key) {
+    // A transaction sees its own uncommitted writes, which must not be shared.
+    if (file_.IsInTransaction()) {
+      return file_.Get<T>(key);
+    }
+    Shard& shard = ShardFor(key);
+    uint64_t version;
+    {
+      std::lock_guard lock(shard.mutex);
+      auto it = shard.index.find(key);
+      if (it != shard.index.end()) {
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        hits_.fetch_add(1, std::memory_order_relaxed);
+        return it->second->second;
+      }
+      version = shard.version;
+    }
+    misses_.fetch_add(1, std::memory_order_relaxed);
+
+    std::optional<T> row = file_.Get<T>(key);
+    if (row.has_value()) {
+      std::lock_guard lock(shard.mutex);
+      // Skip the fill if the key was invalidated while the row was being read.
+      if (shard.version == version && !shard.index.contains(key)) {
+        shard.lru.emplace_front(key, *row);
+        shard.index.emplace(key, shard.lru.begin());
+        if (shard.lru.size() > shard.capacity) {
+          shard.index.erase(shard.lru.back().first);
+          shard.lru.pop_back();
+          evictions_.fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+    return row;
+  }
+
+  inline void Invalidate(const Key& key) {
+    Shard& shard = ShardFor(key);
+    std::lock_guard lock(shard.mutex);
+    ++shard.version;
+    auto it = shard.index.find(key);
+    if (it != shard.index.end()) {
+      shard.lru.erase(it->second);
+      shard.index.erase(it);
+      invalidations_.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  inline void Clear() {
+    for (auto& shard : shards_) {
+      std::lock_guard lock(shard.mutex);
+      ++shard.version;
+      invalidations_.fetch_add(shard.lru.size(), std::memory_order_relaxed);
+      shard.index.clear();
+      shard.lru.clear();
+    }
+  }
+
+  inline size_t Size() const {
+    size_t size = 0;
+    for (auto& shard : shards_) {
+      std::lock_guard lock(shard.mutex);
+      size += shard.lru.size();
+    }
+    return size;
+  }
+
+  inline Stats GetStats() const {
+    return Stats{hits_.load(std::memory_order_relaxed),
+                 misses_.load(std::memory_order_relaxed),
+                 evictions_.load(std::memory_order_relaxed),
+                 invalidations_.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  struct Shard {
+    mutable std::mutex mutex;
+    std::list<std::pair<Key, T>> lru;  // Most recently used first
+    std::unordered_map<Key, typename std::list<std::pair<Key, T>>::iterator> index;
+    size_t capacity  = 0;
+    uint64_t version = 0;  // Bumped by every invalidation
+  };
+
+  inline Shard& ShardFor(const Key& key) {
+    return shards_[std::hash<Key>{}(key) % shards_.size()];
+  }
+
+  SqliteFile& file_;
+  std::vector<Shard> shards_;
+  std::atomic<uint64_t> hits_          = 0;
+  std::atomic<uint64_t> misses_        = 0;
+  std::atomic<uint64_t> evictions_     = 0;
+  std::atomic<uint64_t> invalidations_ = 0;
+  ChangeSubscription subscription_;  // Declared last so it is released first
+};
+
+}  // namespace sqliteol
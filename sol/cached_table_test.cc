@@ -0,0 +1,122 @@
+#include "sol/cached_table.h"
+
+#include <filesystem>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sol/sql_constructor_builder.h"
+
+using namespace sqliteol;
+using namespace testing;
+
+namespace {
+
+struct User {
+  int id;
+  std::string name;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("CachedTableTestUser")
+        .AddColumn("id", &id)
+        .AddColumn("name", &name)
+        .SetPrimaryKey("id")
+        .Build();
+  }
+};
+
+TEST(CachedTableTest, ReadThroughAndWriteThroughInvalidation) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  db_file.EnsureTable<User>();
+  std::vector<User> users = {{1, "Alice"}, {2, "Bob"}};
+  db_file.InsertRows(users);
+
+  CachedTable<User, int> cache(db_file);
+  ASSERT_TRUE(cache.Get(1).has_value());
+  EXPECT_EQ(cache.Get(1)->name, "Alice");
+  EXPECT_FALSE(cache.Get(3).has_value());
+  EXPECT_EQ(cache.GetStats().hits, 1);
+  EXPECT_EQ(cache.GetStats().misses, 2);
+
+  User renamed = {1, "Alicia"};
+  db_file.Upsert(renamed);
+  EXPECT_EQ(cache.Get(1)->name, "Alicia");
+
+  db_file.Delete<User>(1);
+  EXPECT_FALSE(cache.Get(1).has_value());
+  EXPECT_GE(cache.GetStats().invalidations, 2);
+
+  db_file.DropTable<User>();
+  EXPECT_EQ(cache.Size(), 0);
+}
+
+TEST(CachedTableTest, TransactionWritesInvalidateOnceEnded) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "TransactionWritesInvalidateOnceEnded";
+  std::filesystem::create_directory(dir);
+  {
+    SqliteFile db_file(dir / "test.db", {.mode = ConnectionMode::kCached, .wal = true});
+    db_file.EnsureTable<User>();
+    User user = {1, "Alice"};
+    db_file.Insert(user);
+
+    CachedTable<User, int> cache(db_file);
+    EXPECT_EQ(cache.Get(1)->name, "Alice");
+
+    {
+      Transaction transaction = db_file.BeginTransaction();
+      User renamed            = {1, "Alicia"};
+      db_file.Upsert(renamed);
+      // Another thread still reads, and caches, the committed row.
+      std::thread reader([&] { EXPECT_EQ(cache.Get(1)->name, "Alice"); });
+      reader.join();
+      EXPECT_EQ(cache.Get(1)->name, "Alicia");
+      transaction.Commit();
+    }
+    EXPECT_EQ(cache.Get(1)->name, "Alicia");
+
+    {
+      Transaction transaction = db_file.BeginTransaction();
+      User renamed            = {1, "Rolled back"};
+      db_file.Upsert(renamed);
+      EXPECT_EQ(cache.Get(1)->name, "Rolled back");
+      transaction.Rollback();
+    }
+    EXPECT_EQ(cache.Get(1)->name, "Alicia");
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(CachedTableTest, EvictsLeastRecentlyUsed) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  db_file.EnsureTable<User>();
+  std::vector<User> users = {{1, "a"}, {2, "b"}, {3, "c"}};
+  db_file.InsertRows(users);
+
+  CachedTable<User, int> cache(db_file, {.capacity = 2, .shards = 1});
+  cache.Get(1);
+  cache.Get(2);
+  cache.Get(1);
+  cache.Get(3);  // Evicts 2
+  EXPECT_EQ(cache.Size(), 2);
+  EXPECT_EQ(cache.GetStats().evictions, 1);
+
+  cache.Get(1);
+  EXPECT_EQ(cache.GetStats().hits, 2);
+  cache.Get(2);
+  EXPECT_EQ(cache.GetStats().misses, 4);
+  EXPECT_DOUBLE_EQ(cache.GetStats().HitRate(), 2.0 / 6.0);
+}
+
+TEST(CachedTableTest, RejectsMismatchedKeyType) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  EXPECT_THROW((CachedTable<User, std::string>(db_file)), std::runtime_error);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
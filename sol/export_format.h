@@ -0,0 +1,229 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sqlite3.h"
+
+/**
+ * @file
+ * Encoders of the file formats SqliteFile::Export writes. They append to any `Out`
+ * with Append(std::string_view) and Append(char), such as utils::BufferedFileWriter.
+ *
+ * The binary format is:
+ *   "SOLB", version byte, varint column count, per column varint length + name,
+ *   then per row and column a type byte (SQLITE_INTEGER, SQLITE_FLOAT, SQLITE_TEXT,
+ *   SQLITE_BLOB or SQLITE_NULL) followed by the value: zigzag varint for integers,
+ *   8 little-endian IEEE-754 bytes for floats, varint length + bytes for text and
+ *   blobs, nothing for NULL.
+ */
+
+namespace sqliteol {
+
+enum class ExportFormat {
+  // RFC 4180 CSV with a header record, readable by SqliteFile::Import.
+  kCsv,
+  // Compact length-prefixed binary records (see above).
+  kBinary,
+};
+
+namespace export_format {
+
+inline constexpr std::string_view kBinaryMagic = "SOLB";
+inline constexpr char kBinaryVersion           = 1;
+
+template <typename Out>
+void AppendVarint(Out& out, uint64_t value) {
+  char buffer[10];
+  size_t size = 0;
+  while (value >= 0x80) {
+    buffer[size++] = static_cast<char>((value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  buffer[size++] = static_cast<char>(value);
+  out.Append(std::string_view(buffer, size));
+}
+
+inline uint64_t ReadVarint(std::string_view& input) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (input.empty()) {
+      break;
+    }
+    auto byte = static_cast<uint8_t>(input.front());
+    input.remove_prefix(1);
+    value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::runtime_error("Truncated varint in binary export");
+}
+
+template <typename Out>
+void AppendCsvField(Out& out, std::string_view value, char delimiter) {
+  if (value.find_first_of(std::string_view("\"\r\n", 3)) == std::string_view::npos &&
+      value.find(delimiter) == std::string_view::npos) {
+    out.Append(value);
+    return;
+  }
+  out.Append('"');
+  size_t quote;
+  while ((quote = value.find('"')) != std::string_view::npos) {
+    out.Append(value.substr(0, quote + 1));
+    out.Append('"');
+    value.remove_prefix(quote + 1);
+  }
+  out.Append(value);
+  out.Append('"');
+}
+
+template <typename Out, typename Number>
+void AppendNumber(Out& out, Number value) {
+  char buffer[32];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.Append(std::string_view(buffer, end - buffer));
+}
+
+// Appends column `index` of the current row of `stmt` as a CSV field.
+template <typename Out>
+void AppendCsvColumn(Out& out, sqlite3_stmt* stmt, int index, char delimiter) {
+  switch (sqlite3_column_type(stmt, index)) {
+    case SQLITE_INTEGER:
+      AppendNumber(out, sqlite3_column_int64(stmt, index));
+      break;
+    case SQLITE_FLOAT:
+      AppendNumber(out, sqlite3_column_double(stmt, index));
+      break;
+    case SQLITE_NULL:
+      break;
+    default: {
+      const void* data = sqlite3_column_blob(stmt, index);
+      int size         = sqlite3_column_bytes(stmt, index);
+      AppendCsvField(
+          out, std::string_view(static_cast<const char*>(data), size), delimiter);
+    }
+  }
+}
+
+template <typename Out>
+void AppendBinaryHeader(Out& out, const std::vector<std::string_view>& column_names) {
+  out.Append(kBinaryMagic);
+  out.Append(kBinaryVersion);
+  AppendVarint(out, column_names.size());
+  for (std::string_view name : column_names) {
+    AppendVarint(out, name.size());
+    out.Append(name);
+  }
+}
+
+// Appends column `index` of the current row of `stmt` as a binary value.
+template <typename Out>
+void AppendBinaryColumn(Out& out, sqlite3_stmt* stmt, int index) {
+  int type = sqlite3_column_type(stmt, index);
+  out.Append(static_cast<char>(type));
+  switch (type) {
+    case SQLITE_INTEGER: {
+      auto value = static_cast<uint64_t>(sqlite3_column_int64(stmt, index));
+      AppendVarint(out, (value << 1) ^ (0 - (value >> 63)));  // Zigzag
+      break;
+    }
+    case SQLITE_FLOAT: {
+      double value = sqlite3_column_double(stmt, index);
+      uint64_t bits;
+      std::memcpy(&bits, &value, sizeof(bits));
+      char bytes[8];
+      for (int i = 0; i < 8; ++i) {
+        bytes[i] = static_cast<char>(bits >> (8 * i));
+      }
+      out.Append(std::string_view(bytes, sizeof(bytes)));
+      break;
+    }
+    case SQLITE_NULL:
+      break;
+    default: {
+      const void* data = sqlite3_column_blob(stmt, index);
+      int size         = sqlite3_column_bytes(stmt, index);
+      AppendVarint(out, static_cast<uint64_t>(size));
+      out.Append(std::string_view(static_cast<const char*>(data), size));
+    }
+  }
+}
+
+// Reads the header of a binary export off `input` and returns its column names.
+inline std::vector<std::string_view> ReadBinaryHeader(std::string_view& input) {
+  if (!input.starts_with(kBinaryMagic) || input.size() <= kBinaryMagic.size() ||
+      input[kBinaryMagic.size()] != kBinaryVersion) {
+    throw std::runtime_error("Not a binary export of a supported version");
+  }
+  input.remove_prefix(kBinaryMagic.size() + 1);
+  std::vector<std::string_view> column_names(ReadVarint(input));
+  for (auto& name : column_names) {
+    uint64_t size = ReadVarint(input);
+    if (size > input.size()) {
+      throw std::runtime_error("Truncated binary export header");
+    }
+    name = input.substr(0, size);
+    input.remove_prefix(size);
+  }
+  return column_names;
+}
+
+struct BinaryValue {
+  int type        = SQLITE_NULL;
+  int64_t integer = 0;
+  double real     = 0;
+  std::string_view bytes;  // SQLITE_TEXT and SQLITE_BLOB
+};
+
+// Reads one value of a binary export row off `input`.
+inline BinaryValue ReadBinaryValue(std::string_view& input) {
+  if (input.empty()) {
+    throw std::runtime_error("Truncated binary export row");
+  }
+  BinaryValue value;
+  value.type = static_cast<uint8_t>(input.front());
+  input.remove_prefix(1);
+  switch (value.type) {
+    case SQLITE_INTEGER: {
+      uint64_t zigzag = ReadVarint(input);
+      value.integer   = static_cast<int64_t>((zigzag >> 1) ^ (0 - (zigzag & 1)));
+      break;
+    }
+    case SQLITE_FLOAT: {
+      if (input.size() < 8) {
+        throw std::runtime_error("Truncated binary export row");
+      }
+      uint64_t bits = 0;
+      for (int i = 0; i < 8; ++i) {
+        bits |= static_cast<uint64_t>(static_cast<uint8_t>(input[i])) << (8 * i);
+      }
+      std::memcpy(&value.real, &bits, sizeof(bits));
+      input.remove_prefix(8);
+      break;
+    }
+    case SQLITE_TEXT:
+    case SQLITE_BLOB: {
+      uint64_t size = ReadVarint(input);
+      if (size > input.size()) {
+        throw std::runtime_error("Truncated binary export row");
+      }
+      value.bytes = input.substr(0, size);
+      input.remove_prefix(size);
+      break;
+    }
+    case SQLITE_NULL:
+      break;
+    default:
+      throw std::runtime_error("Unknown value type in binary export");
+  }
+  return value;
+}
+
+}  // namespace export_format
+}  // namespace sqliteol
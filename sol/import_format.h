@@ -0,0 +1,372 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @file
+ * Record splitting and parsing of the text formats SqliteFile::Import reads. Parsers
+ * work on string_views into the (memory-mapped) input and only copy a field when it
+ * has to be unescaped.
+ */
+
+namespace sqliteol {
+
+enum class ImportFormat {
+  // RFC 4180 CSV: fields may be quoted, "" escapes a quote, quoted fields may span
+  // lines. Both \n and \r\n line endings are accepted.
+  kCsv,
+  // One flat JSON object per line; keys name the columns.
+  kNdjson,
+};
+
+namespace import_format {
+
+/*
+ * Splits `data` into at most `parts` consecutive pieces of similar size that each
+ * start at a record boundary. For CSV, the quote state is tracked so that newlines
+ * inside quoted fields are not taken for record ends.
+ */
+inline std::vector<std::string_view> SplitRecords(std::string_view data,
+                                                  size_t parts,
+                                                  ImportFormat format) {
+  std::vector<std::string_view> pieces;
+  size_t begin = 0;
+  for (size_t i = 1; i < parts && begin < data.size(); ++i) {
+    size_t target  = std::max(begin, data.size() / parts * i);
+    bool in_quotes = false;
+    if (format == ImportFormat::kCsv) {
+      in_quotes = std::count(data.begin() + begin, data.begin() + target, '"') % 2 != 0;
+    }
+    size_t end = target;
+    for (; end < data.size(); ++end) {
+      if (data[end] == '"' && format == ImportFormat::kCsv) {
+        in_quotes = !in_quotes;
+      } else if (data[end] == '\n' && !in_quotes) {
+        break;
+      }
+    }
+    if (end >= data.size()) {
+      break;
+    }
+    pieces.push_back(data.substr(begin, end + 1 - begin));
+    begin = end + 1;
+  }
+  if (begin < data.size()) {
+    pieces.push_back(data.substr(begin));
+  }
+  return pieces;
+}
+
+/*
+ * Parses the CSV record at the front of `input` and removes it from `input`, calling
+ * `on_field(index, value)` for every field. Blank lines are skipped. Returns false
+ * once `input` holds no more records. Unescaped quoted fields are built in `scratch`.
+ */
+template <typename OnField>
+bool ParseCsvRecord(std::string_view& input,
+                    char delimiter,
+                    std::string& scratch,
+                    OnField&& on_field) {
+  while (!input.empty() && (input.front() == '\n' || input.front() == '\r')) {
+    input.remove_prefix(1);
+  }
+  if (input.empty()) {
+    return false;
+  }
+
+  int index  = 0;
+  size_t pos = 0;
+  while (true) {
+    std::string_view value;
+    if (pos < input.size() && input[pos] == '"') {
+      scratch.clear();
+      ++pos;
+      while (true) {
+        size_t quote = input.find('"', pos);
+        if (quote == std::string_view::npos) {
+          throw std::runtime_error("Unterminated quoted CSV field");
+        }
+        scratch.append(input.data() + pos, quote - pos);
+        pos = quote + 1;
+        if (pos < input.size() && input[pos] == '"') {
+          scratch += '"';
+          ++pos;
+        } else {
+          break;
+        }
+      }
+      value = scratch;
+    } else {
+      size_t end = pos;
+      while (end < input.size() && input[end] != delimiter && input[end] != '\n') {
+        ++end;
+      }
+      value = input.substr(pos, end - pos);
+      if (!value.empty() && value.back() == '\r' &&
+          (end == input.size() || input[end] == '\n')) {
+        value.remove_suffix(1);
+      }
+      pos = end;
+    }
+    on_field(index++, value);
+
+    if (pos < input.size() && input[pos] == delimiter) {
+      ++pos;
+      continue;
+    }
+    if (pos < input.size() && input[pos] == '\r') {
+      ++pos;
+    }
+    if (pos >= input.size()) {
+      input = {};
+      return true;
+    }
+    if (input[pos] != '\n') {
+      throw std::runtime_error("Malformed CSV record: text after a quoted field");
+    }
+    input.remove_prefix(pos + 1);
+    return true;
+  }
+}
+
+namespace internal {
+
+inline void SkipJsonWhitespace(std::string_view input, size_t& pos) {
+  while (pos < input.size() &&
+         (input[pos] == ' ' || input[pos] == '\t' || input[pos] == '\r')) {
+    ++pos;
+  }
+}
+
+inline void AppendUtf8(std::string& out, uint32_t code_point) {
+  if (code_point < 0x80) {
+    out += static_cast<char>(code_point);
+  } else if (code_point < 0x800) {
+    out += static_cast<char>(0xC0 | (code_point >> 6));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else if (code_point < 0x10000) {
+    out += static_cast<char>(0xE0 | (code_point >> 12));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  } else {
+    out += static_cast<char>(0xF0 | (code_point >> 18));
+    out += static_cast<char>(0x80 | ((code_point >> 12) & 0x3F));
+    out += static_cast<char>(0x80 | ((code_point >> 6) & 0x3F));
+    out += static_cast<char>(0x80 | (code_point & 0x3F));
+  }
+}
+
+inline uint32_t ParseHex4(std::string_view input, size_t pos) {
+  if (pos + 4 > input.size()) {
+    throw std::runtime_error("Truncated \\u escape in JSON string");
+  }
+  uint32_t value = 0;
+  for (size_t i = pos; i < pos + 4; ++i) {
+    char c = input[i];
+    value <<= 4;
+    if (c >= '0' && c <= '9') {
+      value |= c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+      value |= c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+      value |= c - 'A' + 10;
+    } else {
+      throw std::runtime_error("Invalid \\u escape in JSON string");
+    }
+  }
+  return value;
+}
+
+/*
+ * Parses the JSON string starting at the quote at `pos` and moves `pos` past it.
+ * Strings without escapes are returned as a view into `input`.
+ */
+inline std::string_view ParseJsonString(std::string_view input,
+                                        size_t& pos,
+                                        std::string& scratch) {
+  size_t begin = ++pos;
+  size_t end   = input.find_first_of("\"\\", begin);
+  if (end == std::string_view::npos) {
+    throw std::runtime_error("Unterminated JSON string");
+  }
+  if (input[end] == '"') {
+    pos = end + 1;
+    return input.substr(begin, end - begin);
+  }
+
+  scratch.assign(input.data() + begin, end - begin);
+  pos = end;
+  while (pos < input.size() && input[pos] != '"') {
+    if (input[pos] != '\\') {
+      scratch += input[pos++];
+      continue;
+    }
+    if (++pos >= input.size()) {
+      break;
+    }
+    char escape = input[pos++];
+    switch (escape) {
+      case 'b':
+        scratch += '\b';
+        break;
+      case 'f':
+        scratch += '\f';
+        break;
+      case 'n':
+        scratch += '\n';
+        break;
+      case 'r':
+        scratch += '\r';
+        break;
+      case 't':
+        scratch += '\t';
+        break;
+      case 'u': {
+        uint32_t code_point = ParseHex4(input, pos);
+        pos += 4;
+        if (code_point >= 0xD800 && code_point < 0xDC00 && pos + 6 <= input.size() &&
+            input[pos] == '\\' && input[pos + 1] == 'u') {
+          uint32_t low = ParseHex4(input, pos + 2);
+          pos += 6;
+          code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+        }
+        AppendUtf8(scratch, code_point);
+        break;
+      }
+      default:
+        scratch += escape;
+        break;
+    }
+  }
+  if (pos >= input.size()) {
+    throw std::runtime_error("Unterminated JSON string");
+  }
+  ++pos;
+  return scratch;
+}
+
+// Moves `pos` past the object or array starting at `pos`.
+inline void SkipJsonContainer(std::string_view input, size_t& pos) {
+  int depth = 0;
+  std::string ignored;
+  while (pos < input.size()) {
+    char c = input[pos];
+    if (c == '"') {
+      ParseJsonString(input, pos, ignored);
+      continue;
+    }
+    ++pos;
+    if (c == '{' || c == '[') {
+      ++depth;
+    } else if ((c == '}' || c == ']') && --depth == 0) {
+      return;
+    }
+  }
+  throw std::runtime_error("Unterminated JSON value");
+}
+
+}  // namespace internal
+
+/*
+ * Parses the flat JSON object on the line at the front of `input` and removes the
+ * line from `input`, calling `on_field(key, value)` for every member. Strings are
+ * unescaped, numbers are passed as written, true/false as "1"/"0", nested objects
+ * and arrays as their raw JSON text, and null as std::nullopt. Blank lines are
+ * skipped. Returns false once `input` holds no more records.
+ */
+template <typename OnField>
+bool ParseJsonRecord(std::string_view& input,
+                     std::string& key_scratch,
+                     std::string& value_scratch,
+                     OnField&& on_field) {
+  size_t pos = 0;
+  while (true) {
+    internal::SkipJsonWhitespace(input, pos);
+    if (pos < input.size() && input[pos] == '\n') {
+      ++pos;
+      continue;
+    }
+    break;
+  }
+  if (pos >= input.size()) {
+    input = {};
+    return false;
+  }
+  if (input[pos] != '{') {
+    throw std::runtime_error("NDJSON record is not an object");
+  }
+  ++pos;
+
+  internal::SkipJsonWhitespace(input, pos);
+  bool empty_object = pos < input.size() && input[pos] == '}';
+  while (!empty_object) {
+    internal::SkipJsonWhitespace(input, pos);
+    if (pos >= input.size() || input[pos] != '"') {
+      throw std::runtime_error("Expected a key in NDJSON record");
+    }
+    std::string_view key = internal::ParseJsonString(input, pos, key_scratch);
+    internal::SkipJsonWhitespace(input, pos);
+    if (pos >= input.size() || input[pos] != ':') {
+      throw std::runtime_error("Expected ':' in NDJSON record");
+    }
+    ++pos;
+    internal::SkipJsonWhitespace(input, pos);
+    if (pos >= input.size()) {
+      throw std::runtime_error("Truncated NDJSON record");
+    }
+
+    char first = input[pos];
+    if (first == '"') {
+      on_field(key, std::optional<std::string_view>(
+                        internal::ParseJsonString(input, pos, value_scratch)));
+    } else if (first == '{' || first == '[') {
+      size_t begin = pos;
+      internal::SkipJsonContainer(input, pos);
+      on_field(key, std::optional<std::string_view>(input.substr(begin, pos - begin)));
+    } else {
+      size_t begin = pos;
+      while (pos < input.size() && input[pos] != ',' && input[pos] != '}' &&
+             input[pos] != ' ' && input[pos] != '\t' && input[pos] != '\r' &&
+             input[pos] != '\n') {
+        ++pos;
+      }
+      std::string_view literal = input.substr(begin, pos - begin);
+      if (literal == "null") {
+        on_field(key, std::optional<std::string_view>());
+      } else if (literal == "true") {
+        on_field(key, std::optional<std::string_view>("1"));
+      } else if (literal == "false") {
+        on_field(key, std::optional<std::string_view>("0"));
+      } else {
+        on_field(key, std::optional<std::string_view>(literal));
+      }
+    }
+
+    internal::SkipJsonWhitespace(input, pos);
+    if (pos < input.size() && input[pos] == ',') {
+      ++pos;
+      continue;
+    }
+    if (pos < input.size() && input[pos] == '}') {
+      break;
+    }
+    throw std::runtime_error("Expected ',' or '}' in NDJSON record");
+  }
+  ++pos;
+
+  internal::SkipJsonWhitespace(input, pos);
+  if (pos < input.size() && input[pos] != '\n') {
+    throw std::runtime_error("Text after the object in NDJSON record");
+  }
+  input.remove_prefix(std::min(pos + 1, input.size()));
+  return true;
+}
+
+}  // namespace import_format
+}  // namespace sqliteol
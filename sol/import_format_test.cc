@@ -0,0 +1,93 @@
+#include "sol/import_format.h"
+
+#include <string>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using namespace sqliteol;
+using namespace testing;
+
+namespace {
+
+std::vector<std::vector<std::string>> ParseCsv(std::string_view input) {
+  std::vector<std::vector<std::string>> records;
+  std::string scratch;
+  while (true) {
+    std::vector<std::string> fields;
+    if (!import_format::ParseCsvRecord(
+            input, ',', scratch, [&](int, std::string_view value) {
+              fields.emplace_back(value);
+            })) {
+      return records;
+    }
+    records.push_back(fields);
+  }
+}
+
+}  // namespace
+
+TEST(ImportFormatTest, ParseCsvQuotedFields) {
+  auto records = ParseCsv("a,\"b,c\",\"say \"\"hi\"\"\"\r\n\n1,\"two\nlines\",\n");
+  ASSERT_EQ(records.size(), 2);
+  EXPECT_THAT(records[0], ElementsAre("a", "b,c", "say \"hi\""));
+  EXPECT_THAT(records[1], ElementsAre("1", "two\nlines", ""));
+}
+
+TEST(ImportFormatTest, ParseCsvRejectsUnterminatedQuote) {
+  EXPECT_THROW(ParseCsv("\"abc\n"), std::runtime_error);
+}
+
+TEST(ImportFormatTest, ParseJsonRecord) {
+  std::string_view input =
+      "{\"id\": 7, \"name\": \"a\\\"b\\u00e9\", \"ok\": true, \"tags\": [1, {\"x\": "
+      "\"]\"}], \"gone\": null}\n{}\n";
+  std::string key_scratch;
+  std::string value_scratch;
+  std::vector<std::pair<std::string, std::string>> fields;
+  ASSERT_TRUE(import_format::ParseJsonRecord(
+      input,
+      key_scratch,
+      value_scratch,
+      [&](std::string_view key, std::optional<std::string_view> value) {
+        fields.emplace_back(key, value.value_or("<null>"));
+      }));
+  EXPECT_THAT(fields,
+              ElementsAre(Pair("id", "7"),
+                          Pair("name", "a\"b\xc3\xa9"),
+                          Pair("ok", "1"),
+                          Pair("tags", "[1, {\"x\": \"]\"}]"),
+                          Pair("gone", "<null>")));
+  fields.clear();
+  ASSERT_TRUE(import_format::ParseJsonRecord(
+      input, key_scratch, value_scratch, [&](auto key, auto value) {
+        fields.emplace_back(key, *value);
+      }));
+  EXPECT_TRUE(fields.empty());
+  EXPECT_FALSE(import_format::ParseJsonRecord(
+      input, key_scratch, value_scratch, [](auto, auto) {}));
+}
+
+TEST(ImportFormatTest, SplitRecordsKeepsQuotedNewlinesTogether) {
+  std::string data;
+  for (int i = 0; i < 100; ++i) {
+    data += std::to_string(i) + ",\"multi\nline\"\n";
+  }
+  auto pieces = import_format::SplitRecords(data, 7, ImportFormat::kCsv);
+  EXPECT_GT(pieces.size(), 1);
+
+  std::string joined;
+  size_t records = 0;
+  for (std::string_view piece : pieces) {
+    joined += piece;
+    records += ParseCsv(piece).size();
+  }
+  EXPECT_EQ(joined, data);
+  EXPECT_EQ(records, 100);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "sol/logger.h"
+#include "sol/utils/str_utils.h"
+#include "sqlite3.h"
+
+namespace sqliteol {
+
+// I/O made by sqlite on one file (database, rollback journal or WAL).
+struct FileIoStats {
+  std::string path;
+  int64_t reads      = 0;
+  int64_t read_bytes = 0;
+  std::chrono::nanoseconds read_time{0};
+  int64_t writes      = 0;
+  int64_t write_bytes = 0;
+  std::chrono::nanoseconds write_time{0};
+  int64_t syncs = 0;
+  std::chrono::nanoseconds sync_time{0};
+  std::chrono::nanoseconds max_sync_time{0};
+};
+
+namespace internal {
+
+struct FileIoCounters {
+  explicit FileIoCounters(std::string path) : path(std::move(path)) {
+  }
+
+  const std::string path;
+  std::atomic<int64_t> reads       = 0;
+  std::atomic<int64_t> read_bytes  = 0;
+  std::atomic<int64_t> read_ns     = 0;
+  std::atomic<int64_t> writes      = 0;
+  std::atomic<int64_t> write_bytes = 0;
+  std::atomic<int64_t> write_ns    = 0;
+  std::atomic<int64_t> syncs       = 0;
+  std::atomic<int64_t> sync_ns     = 0;
+  std::atomic<int64_t> max_sync_ns = 0;
+};
+
+// An open file of IoStatsVfs: the underlying VFS's file follows it in memory.
+struct IoStatsFile {
+  sqlite3_file base;
+  FileIoCounters* counters;  // nullptr for unnamed temporary files, not counted
+
+  inline sqlite3_file* real() {
+    return reinterpret_cast<sqlite3_file*>(this + 1);
+  }
+};
+
+}  // namespace internal
+
+/**
+ * @class IoStatsVfs
+ * @brief A VFS shim over the default (unix) VFS counting reads, writes and syncs, with
+ *        their bytes and latencies, per file.
+ *
+ * @details Databases opened with ConnectionOptions::io_stats go through it; see
+ *          SqliteFile::GetIoStats for the counters of one database. Counters are
+ *          kept per path for the lifetime of the process and shared by every
+ *          connection opening that path. A sync slower than the threshold set by
+ *          SetSlowSyncThreshold is logged at info level.
+ *
+ *          The shim adds two clock reads per counted call and nothing else; other
+ *          calls are forwarded unchanged.
+ */
+class IoStatsVfs {
+ public:
+  static constexpr const char* kName = "sol_io_stats";
+
+  // Registers the shim, once, without making it the default VFS. Returns its name.
+  inline static const char* Register() {
+    State& state = GetState();
+    std::call_once(state.registered, [&state] {
+      sqlite3_initialize();
+      sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+      if (!real) {
+        throw std::runtime_error("No default sqlite VFS to wrap");
+      }
+      sqlite3_vfs& vfs      = state.vfs;
+      vfs.iVersion          = 3;
+      vfs.szOsFile          = sizeof(internal::IoStatsFile) + real->szOsFile;
+      vfs.mxPathname        = real->mxPathname;
+      vfs.zName             = kName;
+      vfs.pAppData          = real;
+      vfs.xOpen             = Open;
+      vfs.xDelete           = Delete;
+      vfs.xAccess           = Access;
+      vfs.xFullPathname     = FullPathname;
+      vfs.xDlOpen           = DlOpen;
+      vfs.xDlError          = DlError;
+      vfs.xDlSym            = DlSym;
+      vfs.xDlClose          = DlClose;
+      vfs.xRandomness       = Randomness;
+      vfs.xSleep            = Sleep;
+      vfs.xCurrentTime      = CurrentTime;
+      vfs.xGetLastError     = GetLastError;
+      vfs.xCurrentTimeInt64 = CurrentTimeInt64;
+      if (int rc = sqlite3_vfs_register(&vfs, 0); rc != SQLITE_OK) {
+        throw std::runtime_error(
+            utils::StrCombine("Failed to register VFS: ", sqlite3_errstr(rc)));
+      }
+    });
+    return kName;
+  }
+
+  // Counters of every file opened through the shim so far, by path.
+  inline static std::vector<FileIoStats> Snapshot() {
+    auto load = [](const std::atomic<int64_t>& counter) {
+      return counter.load(std::memory_order_relaxed);
+    };
+    using std::chrono::nanoseconds;
+
+    State& state = GetState();
+    std::vector<FileIoStats> snapshot;
+    std::lock_guard lock(state.mutex);
+    for (const auto& [path, counters] : state.files) {
+      FileIoStats& stats  = snapshot.emplace_back();
+      stats.path          = path;
+      stats.reads         = load(counters->reads);
+      stats.read_bytes    = load(counters->read_bytes);
+      stats.read_time     = nanoseconds(load(counters->read_ns));
+      stats.writes        = load(counters->writes);
+      stats.write_bytes   = load(counters->write_bytes);
+      stats.write_time    = nanoseconds(load(counters->write_ns));
+      stats.syncs         = load(counters->syncs);
+      stats.sync_time     = nanoseconds(load(counters->sync_ns));
+      stats.max_sync_time = nanoseconds(load(counters->max_sync_ns));
+    }
+    return snapshot;
+  }
+
+  // Logs every sync taking longer than `threshold`; zero, the default, logs none.
+  inline static void SetSlowSyncThreshold(std::chrono::nanoseconds threshold) {
+    GetState().slow_sync_ns.store(threshold.count(), std::memory_order_relaxed);
+  }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct State {
+    std::once_flag registered;
+    sqlite3_vfs vfs = {};
+    std::atomic<int64_t> slow_sync_ns = 0;
+
+    std::mutex mutex;
+    // Never erased, so open files can keep pointers to their counters.
+    std::map<std::string, std::unique_ptr<internal::FileIoCounters>> files;
+  };
+
+  // Never destroyed: sqlite keeps using the VFS until the process exits.
+  inline static State& GetState() {
+    static State* state = new State();
+    return *state;
+  }
+
+  inline static sqlite3_vfs* Real(sqlite3_vfs* vfs) {
+    return static_cast<sqlite3_vfs*>(vfs->pAppData);
+  }
+
+  inline static internal::IoStatsFile* Cast(sqlite3_file* file) {
+    return reinterpret_cast<internal::IoStatsFile*>(file);
+  }
+
+  inline static int64_t ElapsedNs(Clock::time_point begin) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - begin)
+        .count();
+  }
+
+  inline static internal::FileIoCounters* CountersFor(const char* path) {
+    State& state = GetState();
+    std::lock_guard lock(state.mutex);
+    auto& counters = state.files[path];
+    if (!counters) {
+      counters = std::make_unique<internal::FileIoCounters>(path);
+    }
+    return counters.get();
+  }
+
+  // File methods.
+
+  inline static int Close(sqlite3_file* file) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xClose(real);
+  }
+
+  inline static int Read(sqlite3_file* file,
+                         void* data,
+                         int amount,
+                         sqlite3_int64 offset) {
+    internal::IoStatsFile* stats_file = Cast(file);
+    sqlite3_file* real                = stats_file->real();
+    if (!stats_file->counters) {
+      return real->pMethods->xRead(real, data, amount, offset);
+    }
+    Clock::time_point begin = Clock::now();
+    int rc                  = real->pMethods->xRead(real, data, amount, offset);
+
+    internal::FileIoCounters& counters = *stats_file->counters;
+    counters.read_ns.fetch_add(ElapsedNs(begin), std::memory_order_relaxed);
+    counters.reads.fetch_add(1, std::memory_order_relaxed);
+    counters.read_bytes.fetch_add(amount, std::memory_order_relaxed);
+    return rc;
+  }
+
+  inline static int Write(sqlite3_file* file,
+                          const void* data,
+                          int amount,
+                          sqlite3_int64 offset) {
+    internal::IoStatsFile* stats_file = Cast(file);
+    sqlite3_file* real                = stats_file->real();
+    if (!stats_file->counters) {
+      return real->pMethods->xWrite(real, data, amount, offset);
+    }
+    Clock::time_point begin = Clock::now();
+    int rc                  = real->pMethods->xWrite(real, data, amount, offset);
+
+    internal::FileIoCounters& counters = *stats_file->counters;
+    counters.write_ns.fetch_add(ElapsedNs(begin), std::memory_order_relaxed);
+    counters.writes.fetch_add(1, std::memory_order_relaxed);
+    counters.write_bytes.fetch_add(amount, std::memory_order_relaxed);
+    return rc;
+  }
+
+  inline static int Truncate(sqlite3_file* file, sqlite3_int64 size) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xTruncate(real, size);
+  }
+
+  inline static int Sync(sqlite3_file* file, int flags) {
+    internal::IoStatsFile* stats_file = Cast(file);
+    sqlite3_file* real                = stats_file->real();
+    if (!stats_file->counters) {
+      return real->pMethods->xSync(real, flags);
+    }
+    Clock::time_point begin            = Clock::now();
+    int rc                             = real->pMethods->xSync(real, flags);
+    int64_t elapsed_ns                 = ElapsedNs(begin);
+    internal::FileIoCounters& counters = *stats_file->counters;
+    counters.sync_ns.fetch_add(elapsed_ns, std::memory_order_relaxed);
+    counters.syncs.fetch_add(1, std::memory_order_relaxed);
+    int64_t max_ns = counters.max_sync_ns.load(std::memory_order_relaxed);
+    while (elapsed_ns > max_ns &&
+           !counters.max_sync_ns.compare_exchange_weak(
+               max_ns, elapsed_ns, std::memory_order_relaxed)) {
+    }
+
+    int64_t slow_ns = GetState().slow_sync_ns.load(std::memory_order_relaxed);
+    if (slow_ns > 0 && elapsed_ns > slow_ns) {
+      Logger::getInstance().info(utils::StrCombine("Slow sync of ",
+                                                   counters.path,
+                                                   ": ",
+                                                   std::to_string(elapsed_ns / 1000),
+                                                   " us"));
+    }
+    return rc;
+  }
+
+  inline static int FileSize(sqlite3_file* file, sqlite3_int64* size) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xFileSize(real, size);
+  }
+
+  inline static int Lock(sqlite3_file* file, int lock) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xLock(real, lock);
+  }
+
+  inline static int Unlock(sqlite3_file* file, int lock) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xUnlock(real, lock);
+  }
+
+  inline static int CheckReservedLock(sqlite3_file* file, int* reserved) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xCheckReservedLock(real, reserved);
+  }
+
+  inline static int FileControl(sqlite3_file* file, int op, void* arg) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xFileControl(real, op, arg);
+  }
+
+  inline static int SectorSize(sqlite3_file* file) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xSectorSize(real);
+  }
+
+  inline static int DeviceCharacteristics(sqlite3_file* file) {
+    sqlite3_file* real = Cast(file)->real();
+    return real->pMethods->xDeviceCharacteristics(real);
+  }
+
+  inline static int ShmMap(sqlite3_file* file,
+                           int region,
+                           int size,
+                           int extend,
+                           void volatile** memory) {
+    sqlite3_file* real = Cast(file)->real();
+    if (real->pMethods->iVersion < 2) {
+      return SQLITE_IOERR_SHMMAP;
+    }
+    return real->pMethods->xShmMap(real, region, size, extend, memory);
+  }
+
+  inline static int ShmLock(sqlite3_file* file, int offset, int count, int flags) {
+    sqlite3_file* real = Cast(file)->real();
+    if (real->pMethods->iVersion < 2) {
+      return SQLITE_IOERR_SHMLOCK;
+    }
+    return real->pMethods->xShmLock(real, offset, count, flags);
+  }
+
+  inline static void ShmBarrier(sqlite3_file* file) {
+    sqlite3_file* real = Cast(file)->real();
+    if (real->pMethods->iVersion >= 2) {
+      real->pMethods->xShmBarrier(real);
+    }
+  }
+
+  inline static int ShmUnmap(sqlite3_file* file, int delete_flag) {
+    sqlite3_file* real = Cast(file)->real();
+    if (real->pMethods->iVersion < 2) {
+      return SQLITE_OK;
+    }
+    return real->pMethods->xShmUnmap(real, delete_flag);
+  }
+
+  inline static int Fetch(sqlite3_file* file,
+                          sqlite3_int64 offset,
+                          int amount,
+                          void** page) {
+    sqlite3_file* real = Cast(file)->real();
+    if (real->pMethods->iVersion < 3) {
+      *page = nullptr;
+      return SQLITE_OK;
+    }
+    return real->pMethods->xFetch(real, offset, amount, page);
+  }
+
+  inline static int Unfetch(sqlite3_file* file, sqlite3_int64 offset, void* page) {
+    sqlite3_file* real = Cast(file)->real();
+    if (real->pMethods->iVersion < 3) {
+      return SQLITE_OK;
+    }
+    return real->pMethods->xUnfetch(real, offset, page);
+  }
+
+  inline static constexpr sqlite3_io_methods kIoMethods = {
+      3,
+      Close,
+      Read,
+      Write,
+      Truncate,
+      Sync,
+      FileSize,
+      Lock,
+      Unlock,
+      CheckReservedLock,
+      FileControl,
+      SectorSize,
+      DeviceCharacteristics,
+      ShmMap,
+      ShmLock,
+      ShmBarrier,
+      ShmUnmap,
+      Fetch,
+      Unfetch,
+  };
+
+  // VFS methods, forwarded to the wrapped VFS.
+
+  inline static int Open(sqlite3_vfs* vfs,
+                         const char* name,
+                         sqlite3_file* file,
+                         int flags,
+                         int* out_flags) {
+    internal::IoStatsFile* stats_file = Cast(file);
+    stats_file->base.pMethods         = nullptr;
+    stats_file->counters              = name ? CountersFor(name) : nullptr;
+    int rc = Real(vfs)->xOpen(Real(vfs), name, stats_file->real(), flags, out_flags);
+    // sqlite only closes files whose pMethods is set, even when the open failed.
+    if (stats_file->real()->pMethods) {
+      stats_file->base.pMethods = &kIoMethods;
+    }
+    return rc;
+  }
+
+  inline static int Delete(sqlite3_vfs* vfs, const char* name, int sync_dir) {
+    return Real(vfs)->xDelete(Real(vfs), name, sync_dir);
+  }
+
+  inline static int Access(sqlite3_vfs* vfs, const char* name, int flags, int* result) {
+    return Real(vfs)->xAccess(Real(vfs), name, flags, result);
+  }
+
+  inline static int FullPathname(sqlite3_vfs* vfs,
+                                 const char* name,
+                                 int size,
+                                 char* out) {
+    return Real(vfs)->xFullPathname(Real(vfs), name, size, out);
+  }
+
+  inline static void* DlOpen(sqlite3_vfs* vfs, const char* filename) {
+    return Real(vfs)->xDlOpen(Real(vfs), filename);
+  }
+
+  inline static void DlError(sqlite3_vfs* vfs, int size, char* message) {
+    Real(vfs)->xDlError(Real(vfs), size, message);
+  }
+
+  inline static void (*DlSym(sqlite3_vfs* vfs, void* handle, const char* symbol))(void) {
+    return Real(vfs)->xDlSym(Real(vfs), handle, symbol);
+  }
+
+  inline static void DlClose(sqlite3_vfs* vfs, void* handle) {
+    Real(vfs)->xDlClose(Real(vfs), handle);
+  }
+
+  inline static int Randomness(sqlite3_vfs* vfs, int size, char* out) {
+    return Real(vfs)->xRandomness(Real(vfs), size, out);
+  }
+
+  inline static int Sleep(sqlite3_vfs* vfs, int microseconds) {
+    return Real(vfs)->xSleep(Real(vfs), microseconds);
+  }
+
+  inline static int CurrentTime(sqlite3_vfs* vfs, double* now) {
+    return Real(vfs)->xCurrentTime(Real(vfs), now);
+  }
+
+  inline static int GetLastError(sqlite3_vfs* vfs, int size, char* message) {
+    return Real(vfs)->xGetLastError ? Real(vfs)->xGetLastError(Real(vfs), size, message)
+                                    : 0;
+  }
+
+  inline static int CurrentTimeInt64(sqlite3_vfs* vfs, sqlite3_int64* now) {
+    if (Real(vfs)->iVersion >= 2 && Real(vfs)->xCurrentTimeInt64) {
+      return Real(vfs)->xCurrentTimeInt64(Real(vfs), now);
+    }
+    double days = 0;
+    int rc      = Real(vfs)->xCurrentTime(Real(vfs), &days);
+    *now        = static_cast<sqlite3_int64>(days * 86400000.0);
+    return rc;
+  }
+};
+
+}  // namespace sqliteol
@@ -0,0 +1,344 @@
+/**
+ * @file
+ * Load generator for SqliteFile: reader threads doing keyed Gets race writer threads
+ * doing Upserts against a temporary database for a fixed duration. Every
+ * configuration prints one JSON object per operation, one per line, with throughput,
+ * latency percentiles, the retries the BusyPolicy handler made on SQLITE_BUSY and the
+ * calls that still failed with it and were retried.
+ *
+ * Example usage:
+ *   load_benchmark --readers=8 --writers=1 --seconds=10 --journal=delete,wal
+ *
+ * Comma-separated values of --readers, --writers, --row_bytes, --journal and --mode
+ * run every combination in turn.
+ */
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "sol/sql_constructor_builder.h"
+#include "sol/sqlite_file.h"
+#include "sol/utils/str_utils.h"
+
+using namespace sqliteol;
+
+namespace {
+
+struct BenchmarkRow {
+  int64_t id;
+  std::string payload;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("LoadBenchmarkRow")
+        .AddColumn("id", &id)
+        .AddColumn("payload", &payload)
+        .SetPrimaryKey("id")
+        .Build();
+  }
+};
+
+struct Config {
+  int readers      = 4;
+  int writers      = 1;
+  size_t row_bytes = 256;
+  std::string journal;  // "delete" or "wal"
+  std::string mode;     // "per_call" or "cached"
+  double seconds = 5;
+  int64_t keys   = 10000;
+  std::chrono::milliseconds busy_timeout{0};  // See BusyPolicy
+};
+
+// Latencies and outcome counts of one operation, merged over its threads.
+struct OpStats {
+  std::vector<int64_t> latencies_ns;
+  uint64_t errors        = 0;
+  uint64_t busy_failures = 0;  // Calls failing with SQLITE_BUSY, retried by RunLoop
+  uint64_t busy_retries  = 0;  // Retries of the library's busy handler
+
+  inline void Merge(OpStats&& other) {
+    latencies_ns.insert(
+        latencies_ns.end(), other.latencies_ns.begin(), other.latencies_ns.end());
+    errors += other.errors;
+    busy_failures += other.busy_failures;
+  }
+};
+
+/*
+ * Runs `op` until `stop` is set, timing every call including its retries. A call
+ * the busy handler gave up on with SQLITE_BUSY is retried up to 100 times, other
+ * failures count as errors.
+ */
+template <typename Op>
+OpStats RunLoop(const std::atomic<bool>& stop, Op&& op) {
+  OpStats stats;
+  stats.latencies_ns.reserve(1 << 16);
+  while (!stop.load(std::memory_order_relaxed)) {
+    auto begin = std::chrono::steady_clock::now();
+    bool done  = false;
+    for (int attempt = 0; attempt < 100 && !done; ++attempt) {
+      try {
+        op();
+        done = true;
+      } catch (const SqliteError& e) {
+        if (!e.IsBusy()) {
+          break;
+        }
+        ++stats.busy_failures;
+        std::this_thread::yield();
+      } catch (const std::exception&) {
+        break;
+      }
+    }
+    if (!done) {
+      ++stats.errors;
+      continue;
+    }
+    stats.latencies_ns.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - begin)
+                                     .count());
+  }
+  return stats;
+}
+
+double PercentileUs(std::vector<int64_t>& sorted_ns, double percentile) {
+  if (sorted_ns.empty()) {
+    return 0;
+  }
+  size_t index = static_cast<size_t>(percentile * (sorted_ns.size() - 1));
+  return sorted_ns[index] / 1000.0;
+}
+
+void AppendNumber(std::string& out, double value) {
+  char buffer[32];
+  auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, end);
+}
+
+void PrintResult(const Config& config,
+                 std::string_view op,
+                 OpStats& stats,
+                 double elapsed_seconds) {
+  std::sort(stats.latencies_ns.begin(), stats.latencies_ns.end());
+  std::string line = "{\"sqlite_version\": ";
+  utils::AppendJsonString(line, sqlite3_libversion());
+  line += ", \"journal\": ";
+  utils::AppendJsonString(line, config.journal);
+  line += ", \"mode\": ";
+  utils::AppendJsonString(line, config.mode);
+  utils::StrAppend(line,
+                   ", \"readers\": ",
+                   std::to_string(config.readers),
+                   ", \"writers\": ",
+                   std::to_string(config.writers),
+                   ", \"row_bytes\": ",
+                   std::to_string(config.row_bytes),
+                   ", \"seconds\": ");
+  AppendNumber(line, elapsed_seconds);
+  line += ", \"op\": ";
+  utils::AppendJsonString(line, op);
+  utils::StrAppend(line,
+                   ", \"count\": ",
+                   std::to_string(stats.latencies_ns.size()),
+                   ", \"errors\": ",
+                   std::to_string(stats.errors),
+                   ", \"busy_retries\": ",
+                   std::to_string(stats.busy_retries),
+                   ", \"busy_failures\": ",
+                   std::to_string(stats.busy_failures),
+                   ", \"ops_per_sec\": ");
+  AppendNumber(line, stats.latencies_ns.size() / elapsed_seconds);
+  line += ", \"p50_us\": ";
+  AppendNumber(line, PercentileUs(stats.latencies_ns, 0.5));
+  line += ", \"p99_us\": ";
+  AppendNumber(line, PercentileUs(stats.latencies_ns, 0.99));
+  line += ", \"p999_us\": ";
+  AppendNumber(line, PercentileUs(stats.latencies_ns, 0.999));
+  line += ", \"max_us\": ";
+  AppendNumber(line, PercentileUs(stats.latencies_ns, 1.0));
+  line += "}\n";
+  std::fputs(line.c_str(), stdout);
+  std::fflush(stdout);
+}
+
+void RunConfig(const Config& config) {
+  std::filesystem::path path =
+      std::filesystem::temp_directory_path() /
+      utils::StrCombine("sol_load_benchmark_", std::to_string(::getpid()), ".db");
+  std::filesystem::remove(path);
+
+  ConnectionOptions options;
+  options.mode         = config.mode == "cached" ? ConnectionMode::kCached
+                                                 : ConnectionMode::kPerCall;
+  options.wal          = config.journal == "wal";
+  options.busy.timeout = config.busy_timeout;
+  {
+    SqliteFile db_file(path, options);
+    db_file.EnsureTable<BenchmarkRow>();
+    std::vector<BenchmarkRow> rows;
+    rows.reserve(config.keys);
+    for (int64_t id = 0; id < config.keys; ++id) {
+      rows.push_back({id, std::string(config.row_bytes, 'x')});
+    }
+    db_file.InsertRows(rows);
+    // Readers get pools of their own, so each operation's busy retries are counted
+    // apart. Their connections are separate from the writer's either way.
+    SqliteFile reader_file(path, options);
+
+    std::atomic<bool> stop = false;
+    std::vector<OpStats> reader_stats(config.readers);
+    std::vector<OpStats> writer_stats(config.writers);
+    std::vector<std::thread> threads;
+    for (int i = 0; i < config.readers; ++i) {
+      threads.emplace_back([&, i] {
+        std::mt19937_64 random(i);
+        std::uniform_int_distribution<int64_t> key(0, config.keys - 1);
+        reader_stats[i] =
+            RunLoop(stop, [&] { reader_file.Get<BenchmarkRow>(key(random)); });
+      });
+    }
+    for (int i = 0; i < config.writers; ++i) {
+      threads.emplace_back([&, i] {
+        std::mt19937_64 random(1000 + i);
+        std::uniform_int_distribution<int64_t> key(0, config.keys - 1);
+        BenchmarkRow row = {0, std::string(config.row_bytes, 'y')};
+        writer_stats[i]  = RunLoop(stop, [&] {
+          row.id = key(random);
+          db_file.Upsert(row);
+        });
+      });
+    }
+
+    uint64_t write_retries_before = db_file.GetBusyRetries();
+    auto begin                    = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::duration<double>(config.seconds));
+    stop = true;
+    for (auto& thread : threads) {
+      thread.join();
+    }
+    double elapsed =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+
+    OpStats reads;
+    for (auto& stats : reader_stats) {
+      reads.Merge(std::move(stats));
+    }
+    reads.busy_retries = reader_file.GetBusyRetries();
+    OpStats writes;
+    for (auto& stats : writer_stats) {
+      writes.Merge(std::move(stats));
+    }
+    writes.busy_retries = db_file.GetBusyRetries() - write_retries_before;
+    if (config.readers > 0) {
+      PrintResult(config, "get", reads, elapsed);
+    }
+    if (config.writers > 0) {
+      PrintResult(config, "upsert", writes, elapsed);
+    }
+  }
+  for (const char* suffix : {"", "-wal", "-shm", "-journal"}) {
+    std::filesystem::remove(path.string() + suffix);
+  }
+}
+
+std::vector<std::string> SplitList(std::string_view value) {
+  std::vector<std::string> items;
+  while (true) {
+    size_t comma = value.find(',');
+    items.emplace_back(value.substr(0, comma));
+    if (comma == std::string_view::npos) {
+      return items;
+    }
+    value.remove_prefix(comma + 1);
+  }
+}
+
+void PrintUsage() {
+  std::fputs(
+      "Usage: load_benchmark [--readers=4] [--writers=1] [--row_bytes=256]\n"
+      "                      [--journal=delete|wal] [--mode=per_call|cached]\n"
+      "                      [--seconds=5] [--keys=10000] [--busy_timeout_ms=0]\n"
+      "Comma-separated values of readers, writers, row_bytes, journal and mode run\n"
+      "every combination. Prints one JSON object per configuration and operation.\n",
+      stderr);
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Statements are logged at debug level by default; keep them out of the timings.
+  auto ignore = [](const std::string&) {};
+  auto report = [](const std::string& message) {
+    std::fprintf(stderr, "%s\n", message.c_str());
+  };
+  Logger::getInstance().SetLogFunctions({ignore, ignore, ignore, report, report});
+
+  std::unordered_map<std::string, std::string> flags = {{"readers", "4"},
+                                                        {"writers", "1"},
+                                                        {"row_bytes", "256"},
+                                                        {"journal", "wal"},
+                                                        {"mode", "cached"},
+                                                        {"seconds", "5"},
+                                                        {"keys", "10000"},
+                                                        {"busy_timeout_ms", "0"}};
+  for (int i = 1; i < argc; ++i) {
+    std::string_view arg = argv[i];
+    size_t equals        = arg.find('=');
+    if (!arg.starts_with("--") || equals == std::string_view::npos ||
+        !flags.contains(std::string(arg.substr(2, equals - 2)))) {
+      PrintUsage();
+      return 2;
+    }
+    flags[std::string(arg.substr(2, equals - 2))] = arg.substr(equals + 1);
+  }
+
+  try {
+    for (const std::string& readers : SplitList(flags["readers"])) {
+      for (const std::string& writers : SplitList(flags["writers"])) {
+        for (const std::string& row_bytes : SplitList(flags["row_bytes"])) {
+          for (const std::string& journal : SplitList(flags["journal"])) {
+            for (const std::string& mode : SplitList(flags["mode"])) {
+              if (journal != "delete" && journal != "wal") {
+                throw std::invalid_argument("journal must be delete or wal");
+              }
+              if (mode != "per_call" && mode != "cached") {
+                throw std::invalid_argument("mode must be per_call or cached");
+              }
+              Config config;
+              config.readers      = std::stoi(readers);
+              config.writers      = std::stoi(writers);
+              config.row_bytes    = std::stoul(row_bytes);
+              config.journal      = journal;
+              config.mode         = mode;
+              config.seconds      = std::stod(flags["seconds"]);
+              config.keys         = std::max<int64_t>(std::stoll(flags["keys"]), 1);
+              config.busy_timeout =
+                  std::chrono::milliseconds(std::stoll(flags["busy_timeout_ms"]));
+              RunConfig(config);
+            }
+          }
+        }
+      }
+    }
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "load_benchmark: %s\n", e.what());
+    PrintUsage();
+    return 1;
+  }
+  return 0;
+}
@@ -28,6 +28,10 @@ class Logger {
     log_functions_ = log_functions;
   }
 
+  inline const LogFunction& GetLogFunctions() const {
+    return log_functions_;
+  }
+
   inline void trace(const std::string& message) {
     log_functions_.trace(message);
   }
@@ -0,0 +1,353 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sol/sql_constructor_builder.h"
+#include "sol/sqlite_file.h"
+
+namespace sqliteol {
+
+enum class PartitionPeriod {
+  kHour,   // Tables named <table>_YYYYMMDDHH
+  kDay,    // Tables named <table>_YYYYMMDD
+  kMonth,  // Tables named <table>_YYYYMM
+};
+
+/**
+ * @class PartitionedTable
+ * @brief Stores T rows in one table per time period, so old data is dropped whole.
+ *
+ * @details Every row goes to the partition of the period (UTC) that `time_of(row)`
+ *          falls in. Partitions are copies of T's table, named after it with the
+ *          start of their period appended, and are created on the first write to
+ *          them. Retention is DropBefore, which drops whole partition tables: its
+ *          cost depends on the number of partitions, not on the number of rows, and
+ *          unlike a range DELETE it leaves no index churn behind. Scan reads only
+ *          the partitions overlapping the requested range.
+ *
+ *          Partitions this object created are remembered; dropping them through
+ *          another object or by raw SQL while this one keeps writing to them makes
+ *          those writes fail. All methods are thread-safe: writes and DropBefore run
+ *          in a transaction, or in the calling thread's open one.
+ *
+ * Example usage:
+ *   PartitionedTable<Event> events(db_file, PartitionPeriod::kDay,
+ *                                  [](const Event& e) { return e.time; });
+ *   events.InsertRows(batch);
+ *   events.DropBefore(std::chrono::system_clock::now() - std::chrono::days(30));
+ */
+template <HasSqliteHelper T>
+class PartitionedTable {
+ public:
+  using Clock       = std::chrono::system_clock;
+  using TimePoint   = Clock::time_point;
+  using Constructor = typename RowDecoder<T>::Constructor;
+
+  inline PartitionedTable(SqliteFile& file,
+                          PartitionPeriod period,
+                          std::function<TimePoint(const T&)> time_of)
+      : file_(file), period_(period), time_of_(std::move(time_of)) {
+  }
+
+  PartitionedTable(const PartitionedTable&)            = delete;
+  PartitionedTable& operator=(const PartitionedTable&) = delete;
+
+  // Start of the period `time` falls in.
+  inline TimePoint PartitionStart(TimePoint time) const {
+    using namespace std::chrono;
+    switch (period_) {
+      case PartitionPeriod::kHour:
+        return floor<hours>(time);
+      case PartitionPeriod::kDay:
+        return floor<days>(time);
+      case PartitionPeriod::kMonth: {
+        year_month_day date{floor<days>(time)};
+        return sys_days(date.year() / date.month() / 1);
+      }
+    }
+    return time;
+  }
+
+  // End (exclusive) of the period starting at `start`.
+  inline TimePoint PartitionEnd(TimePoint start) const {
+    using namespace std::chrono;
+    switch (period_) {
+      case PartitionPeriod::kHour:
+        return start + hours(1);
+      case PartitionPeriod::kDay:
+        return start + days(1);
+      case PartitionPeriod::kMonth: {
+        year_month_day date{floor<days>(start)};
+        return sys_days(date.year() / date.month() / 1 + months(1));
+      }
+    }
+    return start;
+  }
+
+  // Name of the table holding the rows of `time`.
+  inline std::string PartitionName(TimePoint time) const {
+    using namespace std::chrono;
+    TimePoint start = PartitionStart(time);
+    sys_days day    = floor<days>(start);
+    year_month_day date{day};
+
+    std::string name(GetDefaultSqliteHelper<T>().GetTableName());
+    name += '_';
+    AppendDigits(name, static_cast<int>(date.year()), 4);
+    AppendDigits(name, static_cast<unsigned>(date.month()), 2);
+    if (period_ != PartitionPeriod::kMonth) {
+      AppendDigits(name, static_cast<unsigned>(date.day()), 2);
+    }
+    if (period_ == PartitionPeriod::kHour) {
+      AppendDigits(name, floor<hours>(start - day).count(), 2);
+    }
+    return name;
+  }
+
+  inline void Insert(T& row) {
+    WithWriterLock([&](bool remember) {
+      file_.Insert(row, EnsurePartition(PartitionStart(time_of_(row)), remember));
+    });
+  }
+
+  /*
+   * Inserts all `rows` atomically. Rows spanning several partitions are copied into
+   * one batch per partition, inserted in a single transaction.
+   */
+  inline void InsertRows(std::vector<T>& rows) {
+    if (rows.empty()) {
+      return;
+    }
+    std::vector<TimePoint> starts;
+    starts.reserve(rows.size());
+    for (const T& row : rows) {
+      starts.push_back(PartitionStart(time_of_(row)));
+    }
+    if (std::all_of(starts.begin(), starts.end(), [&](TimePoint start) {
+          return start == starts.front();
+        })) {
+      WithWriterLock([&](bool remember) {
+        file_.InsertRows(rows, EnsurePartition(starts.front(), remember));
+      });
+      return;
+    }
+
+    std::map<TimePoint, std::vector<T>> batches;
+    for (size_t i = 0; i < rows.size(); ++i) {
+      batches[starts[i]].push_back(rows[i]);
+    }
+    WithWriterLock([&](bool remember) {
+      for (auto& [start, batch] : batches) {
+        file_.InsertRows(batch, EnsurePartition(start, remember));
+      }
+    });
+  }
+
+  // Starts of the periods that have a partition in the database, oldest first.
+  inline std::vector<TimePoint> Partitions() {
+    std::vector<TimePoint> starts;
+    for (const std::string& name : file_.GetTableNames()) {
+      if (auto start = ParsePartitionName(name)) {
+        starts.push_back(*start);
+      }
+    }
+    std::sort(starts.begin(), starts.end());
+    return starts;
+  }
+
+  /*
+   * Returns the rows with `from <= time_of(row) < to`, reading only the partitions
+   * overlapping the range. Rows come partition by partition, oldest first, and in
+   * table order within a partition. Partitions dropped by a concurrent DropBefore
+   * are left out.
+   */
+  inline std::vector<T> Scan(TimePoint from, TimePoint to) {
+    std::vector<TimePoint> starts = Partitions();
+    while (true) {
+      try {
+        return ScanPartitions(starts, from, to);
+      } catch (const std::runtime_error&) {
+        // A listed partition may have been dropped since: list them again, and give
+        // up if none was.
+        std::vector<TimePoint> remaining = Partitions();
+        if (remaining == starts) {
+          throw;
+        }
+        starts = std::move(remaining);
+      }
+    }
+  }
+
+  /*
+   * Drops the partitions whose whole period lies before `cutoff`, in one transaction,
+   * and returns how many were dropped. Rows of the partition `cutoff` falls in are
+   * kept.
+   */
+  inline size_t DropBefore(TimePoint cutoff) {
+    std::vector<TimePoint> expired;
+    for (TimePoint start : Partitions()) {
+      if (PartitionEnd(start) <= cutoff) {
+        expired.push_back(start);
+      }
+    }
+    if (expired.empty()) {
+      return 0;
+    }
+
+    WithWriterLock([&](bool) {
+      // Writes hold the writer lock across EnsurePartition, so none can pick up a
+      // partition between here and its drop.
+      {
+        std::lock_guard lock(mutex_);
+        for (TimePoint start : expired) {
+          partitions_.erase(start);
+        }
+      }
+      for (TimePoint start : expired) {
+        file_.DropTable(WithTableName(GetDefaultSqliteHelper<T>(), PartitionName(start)),
+                        false);
+      }
+    });
+    return expired.size();
+  }
+
+ private:
+  inline static void AppendDigits(std::string& out, long long value, int width) {
+    std::string digits = std::to_string(value);
+    if (digits.size() < static_cast<size_t>(width)) {
+      out.append(width - digits.size(), '0');
+    }
+    out += digits;
+  }
+
+  inline std::optional<TimePoint> ParsePartitionName(std::string_view name) const {
+    using namespace std::chrono;
+    std::string_view base = GetDefaultSqliteHelper<T>().GetTableName();
+    size_t width          = period_ == PartitionPeriod::kMonth ? 6
+                            : period_ == PartitionPeriod::kDay ? 8
+                                                               : 10;
+    if (name.size() != base.size() + 1 + width || !name.starts_with(base) ||
+        name[base.size()] != '_') {
+      return std::nullopt;
+    }
+    std::string_view digits = name.substr(base.size() + 1);
+    if (!std::all_of(digits.begin(), digits.end(), [](char c) {
+          return c >= '0' && c <= '9';
+        })) {
+      return std::nullopt;
+    }
+    auto number = [&](size_t pos, size_t count) {
+      return std::stoi(std::string(digits.substr(pos, count)));
+    };
+
+    int day_of_month = width > 6 ? number(6, 2) : 1;
+    year_month_day date{year(number(0, 4)), month(number(4, 2)), day(day_of_month)};
+    if (!date.ok()) {
+      return std::nullopt;
+    }
+    TimePoint start = sys_days(date);
+    if (width > 8) {
+      int hour = number(8, 2);
+      if (hour > 23) {
+        return std::nullopt;
+      }
+      start += hours(hour);
+    }
+    return start;
+  }
+
+  /*
+   * Runs `func(remember)` in a transaction, or in the calling thread's open one, so
+   * it holds the writer lock throughout: writes and drops of partitions are
+   * serialized. `remember` tells whether partitions created by `func` may be
+   * remembered, which they may not when the caller's transaction can still roll
+   * them back.
+   */
+  template <typename Func>
+  inline void WithWriterLock(Func&& func) {
+    if (file_.IsInTransaction()) {
+      func(false);
+      return;
+    }
+    try {
+      file_.InTransaction([&] { func(true); }, TransactionMode::kImmediate);
+    } catch (...) {
+      // The rollback took the partitions created by `func` with it.
+      std::lock_guard lock(mutex_);
+      partitions_.clear();
+      throw;
+    }
+  }
+
+  inline std::vector<T> ScanPartitions(const std::vector<TimePoint>& starts,
+                                       TimePoint from,
+                                       TimePoint to) {
+    // Stays well below SQLite's default limit of 500 terms per compound SELECT.
+    constexpr size_t kMaxUnion = 100;
+
+    std::vector<std::string> selects;
+    bool needs_filter = false;
+    for (TimePoint start : starts) {
+      TimePoint end = PartitionEnd(start);
+      if (end <= from || start >= to) {
+        continue;
+      }
+      needs_filter |= start < from || end > to;
+      selects.push_back(utils::StrCombine(
+          "SELECT * FROM \"", PartitionName(start), "\""));
+    }
+
+    std::vector<T> rows;
+    for (size_t begin = 0; begin < selects.size(); begin += kMaxUnion) {
+      size_t end = std::min(begin + kMaxUnion, selects.size());
+      std::vector<std::string> chunk(selects.begin() + begin, selects.begin() + end);
+      std::vector<T> part = file_.QueryRows<T>(
+          utils::StrCombine(utils::StrJoin(" UNION ALL ", chunk), ";"), false);
+      for (T& row : part) {
+        if (!needs_filter || (time_of_(row) >= from && time_of_(row) < to)) {
+          rows.push_back(std::move(row));
+        }
+      }
+    }
+    return rows;
+  }
+
+  /*
+   * Returns the constructor of the partition starting at `start`, creating its table,
+   * and remembers it if `remember` is set. Called under the writer lock (see
+   * WithWriterLock); mutex_ is never held across a write, which may wait for it.
+   */
+  inline Constructor EnsurePartition(TimePoint start, bool remember) {
+    {
+      std::lock_guard lock(mutex_);
+      auto it = partitions_.find(start);
+      if (it != partitions_.end()) {
+        return it->second;
+      }
+    }
+    Constructor table = WithTableName(GetDefaultSqliteHelper<T>(), PartitionName(start));
+    file_.EnsureTable(table);
+    if (remember) {
+      std::lock_guard lock(mutex_);
+      partitions_.emplace(start, table);
+    }
+    return table;
+  }
+
+  SqliteFile& file_;
+  PartitionPeriod period_;
+  std::function<TimePoint(const T&)> time_of_;
+
+  std::mutex mutex_;
+  std::map<TimePoint, Constructor> partitions_;  // Partitions known to exist
+};
+
+}  // namespace sqliteol
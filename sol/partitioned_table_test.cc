@@ -0,0 +1,174 @@
+#include "sol/partitioned_table.h"
+
+#include <filesystem>
+#include <thread>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sol/sql_constructor_builder.h"
+
+using namespace sqliteol;
+using namespace testing;
+using namespace std::chrono;
+
+namespace {
+
+struct Event {
+  int64_t time;  // Seconds since the epoch
+  std::string name;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("PartitionedTableTestEvent")
+        .AddColumn("time", &time)
+        .AddColumn("name", &name)
+        .Build();
+  }
+};
+
+struct Unpartitioned {
+  int id;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("PartitionedTableTestUnpartitioned")
+        .AddColumn("id", &id)
+        .Build();
+  }
+};
+
+system_clock::time_point TimeOf(const Event& event) {
+  return system_clock::time_point(seconds(event.time));
+}
+
+int64_t At(year_month_day date, int hour = 0) {
+  return duration_cast<seconds>((sys_days(date) + hours(hour)).time_since_epoch())
+      .count();
+}
+
+std::vector<std::string> Names(const std::vector<Event>& events) {
+  std::vector<std::string> names;
+  for (const Event& event : events) {
+    names.push_back(event.name);
+  }
+  return names;
+}
+
+TEST(PartitionedTableTest, PartitionNames) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  auto time = sys_days(2026y / October / 7) + hours(5) + minutes(30);
+
+  PartitionedTable<Event> hourly(db_file, PartitionPeriod::kHour, TimeOf);
+  PartitionedTable<Event> daily(db_file, PartitionPeriod::kDay, TimeOf);
+  PartitionedTable<Event> monthly(db_file, PartitionPeriod::kMonth, TimeOf);
+  EXPECT_EQ(hourly.PartitionName(time), "PartitionedTableTestEvent_2026100705");
+  EXPECT_EQ(daily.PartitionName(time), "PartitionedTableTestEvent_20261007");
+  EXPECT_EQ(monthly.PartitionName(time), "PartitionedTableTestEvent_202610");
+  EXPECT_EQ(monthly.PartitionEnd(monthly.PartitionStart(time)),
+            sys_days(2026y / November / 1));
+}
+
+TEST(PartitionedTableTest, InsertScanAndDropBefore) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  PartitionedTable<Event> events(db_file, PartitionPeriod::kDay, TimeOf);
+
+  std::vector<Event> batch = {{At(2026y / October / 1, 10), "a"},
+                              {At(2026y / October / 2, 11), "b"},
+                              {At(2026y / October / 2, 23), "c"},
+                              {At(2026y / October / 4, 0), "d"}};
+  events.InsertRows(batch);
+  Event late = {At(2026y / October / 4, 12), "e"};
+  events.Insert(late);
+  // Scans read whole partitions by design.
+  db_file.SetQueryCheck(QueryCheck::kThrow);
+
+  EXPECT_THAT(events.Partitions(),
+              ElementsAre(sys_days(2026y / October / 1),
+                          sys_days(2026y / October / 2),
+                          sys_days(2026y / October / 4)));
+  EXPECT_THAT(Names(events.Scan(sys_days(2026y / October / 1),
+                                sys_days(2026y / October / 5))),
+              ElementsAre("a", "b", "c", "d", "e"));
+  EXPECT_THAT(Names(events.Scan(sys_days(2026y / October / 2) + hours(12),
+                                sys_days(2026y / October / 4) + hours(1))),
+              ElementsAre("c", "d"));
+  EXPECT_THAT(Names(events.Scan(sys_days(2026y / October / 3),
+                                sys_days(2026y / October / 4))),
+              IsEmpty());
+
+  // The partition the cutoff falls in is kept.
+  EXPECT_EQ(events.DropBefore(sys_days(2026y / October / 2) + hours(12)), 1);
+  EXPECT_THAT(events.Partitions(),
+              ElementsAre(sys_days(2026y / October / 2),
+                          sys_days(2026y / October / 4)));
+  EXPECT_THAT(db_file.GetTableNames(),
+              Not(Contains("PartitionedTableTestEvent_20261001")));
+  EXPECT_EQ(events.DropBefore(sys_days(2026y / October / 2)), 0);
+
+  // A dropped partition is recreated by the next write to it.
+  Event again = {At(2026y / October / 1, 8), "f"};
+  events.Insert(again);
+  EXPECT_THAT(Names(events.Scan(sys_days(2026y / October / 1),
+                                sys_days(2026y / October / 2))),
+              ElementsAre("f"));
+}
+
+TEST(PartitionedTableTest, DropBeforeRacesWritesAndScans) {
+  std::filesystem::path dir =
+      std::filesystem::temp_directory_path() / "DropBeforeRacesWritesAndScans";
+  std::filesystem::create_directory(dir);
+  {
+    SqliteFile db_file(dir / "test.db", {.mode = ConnectionMode::kCached, .wal = true});
+    db_file.EnsureTables<Unpartitioned>();
+    PartitionedTable<Event> events(db_file, PartitionPeriod::kDay, TimeOf);
+
+    constexpr int kRounds = 200;
+    std::thread writer([&] {
+      for (int i = 0; i < kRounds; ++i) {
+        Event old = {At(2026y / October / 1, i % 24), "old"};
+        EXPECT_NO_THROW(events.Insert(old));
+      }
+    });
+    std::thread scanner([&] {
+      for (int i = 0; i < kRounds; ++i) {
+        EXPECT_NO_THROW(
+            events.Scan(sys_days(2026y / October / 1), sys_days(2026y / October / 3)));
+      }
+    });
+    for (int i = 0; i < kRounds; ++i) {
+      events.DropBefore(sys_days(2026y / October / 2));
+    }
+    writer.join();
+    scanner.join();
+
+    // Once the drops are over, writes still find their partition.
+    Event last = {At(2026y / October / 1, 1), "last"};
+    events.Insert(last);
+    EXPECT_THAT(Names(events.Scan(sys_days(2026y / October / 1),
+                                  sys_days(2026y / October / 2))),
+                Contains("last"));
+    // Dropping partitions keeps the schema fingerprints of EnsureTables.
+    EXPECT_EQ(events.DropBefore(sys_days(2026y / October / 2)), 1);
+    EXPECT_THAT(db_file.GetTableNames(), Contains("sol_schema_fingerprints"));
+  }
+  std::filesystem::remove_all(dir);
+}
+
+TEST(PartitionedTableTest, IgnoresUnrelatedTables) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  PartitionedTable<Event> events(db_file, PartitionPeriod::kMonth, TimeOf);
+  auto& helper = GetDefaultSqliteHelper<Event>();
+  db_file.EnsureTable(WithTableName(helper, "PartitionedTableTestEvent_archive"));
+  db_file.EnsureTable(WithTableName(helper, "PartitionedTableTestEvent_202613"));
+
+  Event event = {At(2026y / March / 3), "a"};
+  events.Insert(event);
+  EXPECT_THAT(events.Partitions(), ElementsAre(sys_days(2026y / March / 1)));
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
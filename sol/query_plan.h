@@ -0,0 +1,132 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "sol/sqlite3wrap.h"
+#include "sol/utils/str_utils.h"
+#include "sqlite3.h"
+
+namespace sqliteol {
+
+// One node of the tree EXPLAIN QUERY PLAN reports.
+struct QueryPlanStep {
+  int id     = 0;
+  int parent = 0;  // 0 for top-level steps
+  std::string detail;
+
+  // A table visited row by row instead of searched through an index.
+  inline bool IsFullScan() const {
+    return detail.starts_with("SCAN ") && detail.find(" USING ") == std::string::npos;
+  }
+
+  // A temporary B-tree built for ORDER BY, GROUP BY or DISTINCT.
+  inline bool UsesTempBTree() const {
+    return detail.find("USE TEMP B-TREE") != std::string::npos;
+  }
+};
+
+/**
+ * @struct QueryPlan
+ * @brief The plan SQLite picked for one statement, as reported by EXPLAIN QUERY PLAN.
+ *
+ * @details Steps are in the order SQLite reports them, parents before children.
+ *          Covering-index scans ("SCAN t USING COVERING INDEX i") do not count as
+ *          full scans.
+ */
+struct QueryPlan {
+  std::vector<QueryPlanStep> steps;
+
+  inline bool HasFullScan() const {
+    for (const auto& step : steps) {
+      if (step.IsFullScan()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  inline bool HasTempBTree() const {
+    for (const auto& step : steps) {
+      if (step.UsesTempBTree()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // The plan as an indented tree, one step per line, like the sqlite3 shell shows it.
+  inline std::string ToString() const {
+    std::string result;
+    for (const auto& step : steps) {
+      int depth = 0;
+      for (int parent = step.parent; parent != 0; ++depth) {
+        int next = 0;
+        for (const auto& other : steps) {
+          if (other.id == parent) {
+            next = other.parent;
+            break;
+          }
+        }
+        parent = next;
+      }
+      result.append(depth * 2, ' ');
+      result += step.detail;
+      result += '\n';
+    }
+    return result;
+  }
+};
+
+/*
+ * What typed operations do when a statement they ran stepped through a full table
+ * scan or sorted through a temporary B-tree (SQLITE_STMTSTATUS_FULLSCAN_STEP and
+ * SQLITE_STMTSTATUS_SORT).
+ */
+enum class QueryCheck {
+  kOff,
+  kLog,    // Log an error through the Logger
+  kThrow,  // Throw std::runtime_error after the statement ran
+};
+
+namespace sqlite3wrap {
+
+inline QueryPlan ExplainQueryPlan(sqlite3* db, std::string_view sql) {
+  QueryPlan plan;
+  auto stmt = Prepare(db, utils::StrCombine("EXPLAIN QUERY PLAN ", sql));
+  while (Step(stmt.get())) {
+    plan.steps.push_back(QueryPlanStep{sqlite3_column_int(stmt.get(), 0),
+                                       sqlite3_column_int(stmt.get(), 1),
+                                       std::string(ColumnText(stmt.get(), 3))});
+  }
+  return plan;
+}
+
+/*
+ * Applies `check` to what `stmt` did since the last call, and resets its counters.
+ * Full-scan steps and sorts are reported together with the statement's SQL.
+ */
+inline void CheckStatement(sqlite3_stmt* stmt, QueryCheck check) {
+  if (check == QueryCheck::kOff) {
+    return;
+  }
+  int fullscan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+  int sorts          = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+  if (fullscan_steps == 0 && sorts == 0) {
+    return;
+  }
+  std::string message = utils::StrCombine("Statement ran ",
+                                          std::to_string(fullscan_steps),
+                                          " full scan steps and ",
+                                          std::to_string(sorts),
+                                          " sorts: ",
+                                          sqlite3_sql(stmt));
+  if (check == QueryCheck::kThrow) {
+    throw std::runtime_error(message);
+  }
+  Logger::getInstance().error(message);
+}
+
+}  // namespace sqlite3wrap
+}  // namespace sqliteol
@@ -1,7 +1,9 @@
 #pragma once
 
+#include <charconv>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <type_traits>
 
 #include "sol/utils/magic.h"
@@ -54,10 +56,11 @@ T FromDataBaseString(std::string_view str) {
  **********************************/
 namespace sqliteol {
 
-// Integral types specializations
+// Integral types specializations. "INTEGER" rather than "INT": it is one of the type
+// names STRICT tables accept, and an INTEGER PRIMARY KEY aliases the rowid.
 template <std::integral T>
 constexpr std::string_view ToDataBaseType() {
-  return "INT";
+  return "INTEGER";
 }
 
 template <std::integral T>
@@ -67,6 +70,12 @@ std::string ToDataBaseString(const T& value) {
 
 template <std::integral T>
 T FromDataBaseString(std::string_view str) {
+  // Fast path for plain numbers; anything else keeps the lenient std::stoll rules.
+  long long value = 0;
+  auto [end, ec]  = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (ec == std::errc() && end == str.data() + str.size()) {
+    return static_cast<T>(value);
+  }
   return static_cast<T>(std::stoll(std::string(str)));
 }
 
@@ -83,6 +92,12 @@ std::string ToDataBaseString(const T& value) {
 
 template <std::floating_point T>
 T FromDataBaseString(std::string_view str) {
+  // Fast path for plain numbers; anything else keeps the lenient std::stold rules.
+  T value        = 0;
+  auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+  if (ec == std::errc() && end == str.data() + str.size()) {
+    return value;
+  }
   return static_cast<T>(std::stold(std::string(str)));
 }
 
@@ -117,7 +132,7 @@ std::string FromDataBaseString<std::string>(std::string_view str) {
  *
  * template <>
  * constexpr std::string_view sqliteol::ToDataBaseType<MyCustomType>() {
- *   return "TEXT";
+ *   return "TEXT";  // INTEGER, REAL, TEXT, BLOB or ANY to be usable in STRICT tables
  * }
  *
  * template <>
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <optional>
+#include <stdexcept>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
@@ -36,7 +38,19 @@ class SqlConstructor {
   }
 
   inline std::string GetInsertSQL() const {
-    return kTableInfo_->insert_sql_gen(first_field_ref_);
+    std::string sql;
+    sql.reserve(kTableInfo_->insert_sql_size_hint);
+    AppendInsertSQL(sql);
+    return sql;
+  }
+
+  // Appends the INSERT statement of the referenced row to `out`.
+  inline void AppendInsertSQL(std::string& out) const {
+    kTableInfo_->append_insert_sql(first_field_ref_, out);
+  }
+
+  inline size_t GetInsertSQLSizeHint() const {
+    return kTableInfo_->insert_sql_size_hint;
   }
 
   inline void SetFieldByName(const std::string& column_name,
@@ -50,7 +64,7 @@ class SqlConstructor {
   }
 
   template <int I>
-  void SetFieldByIndex(const std::string& value) const {
+  void SetFieldByIndex(std::string_view value) const {
     static_assert(I >= 0 && I < column_size_, "Index out of range");
     if (!first_field_ref_) {
       throw std::runtime_error("first_field_ref_ is nullptr");
@@ -59,6 +73,109 @@ class SqlConstructor {
         FromDataBaseString<ColumnType<I>>(value);
   }
 
+  // Same as SetFieldByIndex<I>, with the column selected at runtime.
+  inline void SetFieldByIndex(int index, std::string_view value) const {
+    magic::ForRange<0, column_size_>([&]<int I>() {
+      if (I == index) {
+        SetFieldByIndex<I>(value);
+      }
+    });
+  }
+
+  template <int I>
+  const ColumnType<I>& GetFieldByIndex() const {
+    static_assert(I >= 0 && I < column_size_, "Index out of range");
+    if (!first_field_ref_) {
+      throw std::runtime_error("first_field_ref_ is nullptr");
+    }
+    return *magic::GetAlignedRefByIndex<RowTuple, I>(first_field_ref_);
+  }
+
+  /*
+   * Field of column I of the referenced row, without GetFieldByIndex's null check:
+   * a load or store at a constant offset, for per-row loops that set the reference
+   * themselves.
+   */
+  template <int I>
+  ColumnType<I>& FieldRef() const {
+    return *magic::GetAlignedRefByIndex<RowTuple, I>(first_field_ref_);
+  }
+
+  inline const std::string& GetInsertStmtSQL() const {
+    return kTableInfo_->insert_stmt_sql;
+  }
+
+  inline std::optional<int> GetColumnIndex(std::string_view column_name) const {
+    auto it = kTableInfo_->column_name_to_index.find(std::string(column_name));
+    if (it == kTableInfo_->column_name_to_index.end()) {
+      return std::nullopt;
+    }
+    return it->second;
+  }
+
+  // Address of the field of column `index`, selected at runtime.
+  inline const void* GetFieldPtrByIndex(int index) const {
+    const void* field = nullptr;
+    magic::ForRange<0, column_size_>([&]<int I>() {
+      if (I == index) {
+        field = magic::GetAlignedRefByIndex<RowTuple, I>(first_field_ref_);
+      }
+    });
+    return field;
+  }
+
+  inline bool HasPrimaryKey() const {
+    return kTableInfo_->primary_key_index >= 0;
+  }
+
+  inline int GetPrimaryKeyIndex() const {
+    return kTableInfo_->primary_key_index;
+  }
+
+  inline const std::type_info* GetPrimaryKeyType() const {
+    return kTableInfo_->primary_key_type;
+  }
+
+  inline const std::string& GetSelectByKeySQL() const {
+    return kTableInfo_->select_by_key_sql;
+  }
+
+  inline const std::string& GetSelectByKeysSQL() const {
+    return kTableInfo_->select_by_keys_sql;
+  }
+
+  inline const std::string& GetUpsertStmtSQL() const {
+    return kTableInfo_->upsert_stmt_sql;
+  }
+
+  // " ON CONFLICT( <primary key> ) DO UPDATE SET ..." overwriting every other column.
+  inline const std::string& GetOnConflictUpdateSQL() const {
+    return kTableInfo_->on_conflict_update_sql;
+  }
+
+  inline const std::string& GetDeleteByKeySQL() const {
+    return kTableInfo_->delete_by_key_sql;
+  }
+
+  inline bool HasFullText() const {
+    return !kTableInfo_->full_text_columns.empty();
+  }
+
+  // Name of the FTS5 index of the full-text columns, see SetFullText.
+  inline const std::string& GetFullTextTableName() const {
+    return kTableInfo_->full_text_table;
+  }
+
+  // Rows matching the FTS5 query parameter, best first, at most the limit parameter.
+  inline const std::string& GetSearchSQL() const {
+    return kTableInfo_->search_sql;
+  }
+
+  // Refills the full-text index from the table.
+  inline const std::string& GetFullTextRebuildSQL() const {
+    return kTableInfo_->full_text_rebuild_sql;
+  }
+
   inline std::string_view GetTableName() const {
     return kTableInfo_->table_name;
   }
@@ -67,6 +184,10 @@ class SqlConstructor {
     return kTableInfo_->column_names;
   }
 
+  inline const TableInfo& GetTableInfo() const {
+    return *kTableInfo_;
+  }
+
  private:
   const TableInfo* kTableInfo_;
   void* first_field_ref_;
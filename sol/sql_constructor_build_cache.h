@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <functional>
 #include <iostream>
 #include <memory>
@@ -7,6 +8,7 @@
 #include <optional>
 #include <shared_mutex>
 #include <string>
+#include <typeinfo>
 #include <unordered_map>
 #include <vector>
 
@@ -14,13 +16,34 @@ namespace sqliteol {
 
 class SqlConstructorBuildCache {
  public:
+  // Appends the INSERT statement of the row at first_field_ref to `out`.
+  using AppendInsertSqlFunc =
+      std::function<void(const void* first_field_ref, std::string& out)>;
+
   struct TableInfo {
-    std::string table_name                                                 = "";
-    std::vector<std::string> column_names                                  = {};
-    std::string ensure_table_sql                                           = "";
-    std::function<std::string(const void* first_field_ref)> insert_sql_gen = nullptr;
-    std::unordered_map<std::string, int> column_name_to_index              = {};
-    const std::type_info* row_tuple_type                                   = nullptr;
+    std::string table_name                                    = "";
+    std::vector<std::string> column_names                     = {};
+    std::vector<std::ptrdiff_t> column_offsets                = {};
+    std::string ensure_table_sql                              = "";
+    AppendInsertSqlFunc append_insert_sql                     = nullptr;
+    size_t insert_sql_size_hint                               = 0;
+    std::string insert_stmt_sql                               = "";
+    std::unordered_map<std::string, int> column_name_to_index = {};
+    const std::type_info* row_tuple_type                      = nullptr;
+    std::string primary_key                                   = "";
+    bool strict                                               = false;
+    bool without_rowid                                        = false;
+    int primary_key_index                                     = -1;
+    const std::type_info* primary_key_type                    = nullptr;
+    std::string select_by_key_sql                             = "";
+    std::string select_by_keys_sql                            = "";
+    std::string upsert_stmt_sql                               = "";
+    std::string on_conflict_update_sql                        = "";
+    std::string delete_by_key_sql                             = "";
+    std::vector<std::string> full_text_columns                = {};
+    std::string full_text_table                               = "";
+    std::string search_sql                                    = "";
+    std::string full_text_rebuild_sql                         = "";
   };
 
   inline static SqlConstructorBuildCache& GetInstance() {
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <string>
 #include <string_view>
 #include <tuple>
@@ -10,6 +11,7 @@
 #include "sol/serialize_template.h"
 #include "sol/sql_constructor.h"
 #include "sol/sql_constructor_build_cache.h"
+#include "sol/utils/sql_buffer.h"
 
 namespace sqliteol {
 
@@ -23,6 +25,8 @@ class SqlConstructorBuilder {
   using BuildCache  = SqlConstructorBuildCache;
   using TableInfo   = BuildCache::TableInfo;
 
+  using AppendInsertSqlFunc = BuildCache::AppendInsertSqlFunc;
+
   template <size_t I>
   static constexpr std::string_view SqliteColumnTypeStr_v =
       ToDataBaseType<std::tuple_element_t<I, CurRowTuple>>();
@@ -56,6 +60,61 @@ class SqlConstructorBuilder {
     return *this;
   }
 
+  /*
+   * Declares `column_name` as the PRIMARY KEY of the table. Keyed lookups
+   * (SqliteFile::Get, Upsert, Delete, CachedTable) require one.
+   */
+  inline SqlConstructorBuilder<CurColumnTypes...>& SetPrimaryKey(
+      std::string_view column_name) {
+    if (!is_built()) {
+      tmp_->primary_key = column_name;
+    }
+    return *this;
+  }
+
+  /*
+   * Creates the table as a STRICT table: every value must match its column's type
+   * exactly instead of being converted by affinity. All column types must be one
+   * of INTEGER, REAL, TEXT, BLOB or ANY (see ToDataBaseType).
+   */
+  inline SqlConstructorBuilder<CurColumnTypes...>& SetStrict() {
+    if (!is_built()) {
+      tmp_->strict = true;
+    }
+    return *this;
+  }
+
+  /*
+   * Creates the table WITHOUT ROWID, stored as one B-tree clustered on the primary
+   * key, which needs SetPrimaryKey. Suits narrow key-value and time-series tables.
+   * Such tables have no rowid, so InsertWithBlob, OpenBlob and OnChange (which
+   * SQLite's update hook does not report for them) do not apply.
+   */
+  inline SqlConstructorBuilder<CurColumnTypes...>& SetWithoutRowid() {
+    if (!is_built()) {
+      tmp_->without_rowid = true;
+    }
+    return *this;
+  }
+
+  /*
+   * Indexes the TEXT column `column_name` for full-text search; call once per
+   * column. EnsureTable then also creates an FTS5 index over these columns, named
+   * "<table>_fts", which triggers keep in sync with every insert, update and delete
+   * (see SqliteFile::Search). The index refers to rows by rowid, so it does not work
+   * WITHOUT ROWID. VACUUM may renumber the rowids of tables without an INTEGER
+   * PRIMARY KEY: SqliteFile::EnableIncrementalVacuum rebuilds the indexes after its
+   * VACUUM, a VACUUM run by hand must be followed by
+   * INSERT INTO "<table>_fts"( "<table>_fts" ) VALUES( 'rebuild' ).
+   */
+  inline SqlConstructorBuilder<CurColumnTypes...>& SetFullText(
+      std::string_view column_name) {
+    if (!is_built()) {
+      tmp_->full_text_columns.emplace_back(column_name);
+    }
+    return *this;
+  }
+
   template <typename ColumnType>
   SqlConstructorBuilder<CurColumnTypes..., ColumnType> AddColumn(
       std::string_view column_name, ColumnType* value) {
@@ -65,11 +124,32 @@ class SqlConstructorBuilder {
 
     if (!is_built()) {
       tmp_->column_names.emplace_back(column_name);
+      tmp_->column_offsets.push_back(reinterpret_cast<const char*>(value) -
+                                     static_cast<const char*>(first_field_ref_));
     }
     return SqlConstructorBuilder<CurColumnTypes..., ColumnType>(
         std::move(tmp_), kTableInfo_, first_field_ref_);
   }
 
+  /*
+   * Builds the constructor of a table named `table_name` with the columns, primary
+   * key and options of `base`. Use the WithTableName shorthand.
+   */
+  inline static SqlConstructor<CurRowTuple> BuildLike(const TableInfo& base,
+                                                      const std::string& table_name) {
+    SqlConstructorBuilder<CurColumnTypes...> builder;
+    builder.SetTableName(table_name);
+    if (!builder.is_built()) {
+      builder.tmp_->column_names      = base.column_names;
+      builder.tmp_->column_offsets    = base.column_offsets;
+      builder.tmp_->primary_key       = base.primary_key;
+      builder.tmp_->strict            = base.strict;
+      builder.tmp_->without_rowid     = base.without_rowid;
+      builder.tmp_->full_text_columns = base.full_text_columns;
+    }
+    return builder.Build();
+  }
+
   inline SqlConstructor<CurRowTuple> Build() {
     if (!is_built()) {
       kTableInfo_ = CreateTableInfo();
@@ -91,62 +171,267 @@ class SqlConstructorBuilder {
   }
 
   inline const TableInfo* CreateTableInfo() {
-    tmp_->ensure_table_sql = GetEnsureTableSql<CurRowTuple>();
-    tmp_->insert_sql_gen   = GetInsertSQLFunc<CurRowTuple>();
+    CheckColumnOffsets();
     for (size_t i = 0; i < tmp_->column_names.size(); ++i) {
       tmp_->column_name_to_index.emplace(tmp_->column_names[i], i);
     }
-    tmp_->row_tuple_type   = &typeid(CurRowTuple);
-    std::string table_name = tmp_->table_name;
+    if (!tmp_->primary_key.empty()) {
+      SetPrimaryKeyInfo<CurRowTuple>();
+    } else if (tmp_->without_rowid) {
+      throw std::runtime_error(utils::StrCombine(
+          "WITHOUT ROWID table needs a primary key: ", tmp_->table_name));
+    }
+    tmp_->ensure_table_sql = GetEnsureTableSql<CurRowTuple>();
+    if (!tmp_->full_text_columns.empty()) {
+      SetFullTextInfo<CurRowTuple>();
+    }
+    tmp_->append_insert_sql    = GetAppendInsertSQLFunc<CurRowTuple>();
+    tmp_->insert_sql_size_hint = GetInsertSQLSizeHint();
+    tmp_->insert_stmt_sql      = GetInsertStmtSql();
+    tmp_->row_tuple_type       = &typeid(CurRowTuple);
+    std::string table_name     = tmp_->table_name;
     BuildCache::GetInstance().AddTableInfo(std::move(*tmp_));
     return BuildCache::GetInstance().GetTableInfo(table_name).value();
   }
 
+  /*
+   * Fields are reached at the offsets magic::GetAlignedRefByIndex computes from the
+   * column types, so the columns must be added in declaration order, without
+   * skipping members in between. AddColumn only sees field addresses, so this is
+   * checked at run time, once per table on its first Build, not at compile time.
+   */
+  inline void CheckColumnOffsets() const {
+    magic::ForRange<0, std::tuple_size_v<CurRowTuple>>([&]<int I>() {
+      constexpr auto kExpected = magic::GetTupleValueOffset<CurRowTuple, I>();
+      if (tmp_->column_offsets[I] != static_cast<std::ptrdiff_t>(kExpected)) {
+        throw std::runtime_error(
+            utils::StrCombine("Column ",
+                              tmp_->column_names[I],
+                              " of ",
+                              tmp_->table_name,
+                              " is not at the offset its type implies; add the "
+                              "columns in member order without gaps"));
+      }
+    });
+  }
+
+  template <typename RowTuple>
+  void SetPrimaryKeyInfo() const {
+    auto it = tmp_->column_name_to_index.find(tmp_->primary_key);
+    if (it == tmp_->column_name_to_index.end()) {
+      throw std::runtime_error(
+          utils::StrCombine("Unknown primary key column: ", tmp_->primary_key));
+    }
+    tmp_->primary_key_index = it->second;
+    magic::ForRange<0, std::tuple_size_v<RowTuple>>([&]<int I>() {
+      if (I == tmp_->primary_key_index) {
+        tmp_->primary_key_type = &typeid(std::tuple_element_t<I, RowTuple>);
+      }
+    });
+
+    const std::string& table_name = tmp_->table_name;
+    const std::string& key        = tmp_->primary_key;
+    std::string updates;
+    for (const auto& column_name : tmp_->column_names) {
+      if (column_name != key) {
+        utils::StrAppend(updates,
+                         updates.empty() ? "UPDATE SET " : ", ",
+                         column_name,
+                         " = excluded.",
+                         column_name);
+      }
+    }
+
+    tmp_->select_by_key_sql = utils::StrCombine(
+        "SELECT * FROM \"", table_name, "\" WHERE ", key, " = ?;");
+    // Keys arrive as one JSON array parameter; `keys.key` is the position in it.
+    tmp_->select_by_keys_sql =
+        utils::StrCombine("SELECT keys.key, t.* FROM json_each(?) AS keys JOIN \"",
+                          table_name,
+                          "\" AS t ON t.",
+                          key,
+                          " = keys.value;");
+    tmp_->delete_by_key_sql =
+        utils::StrCombine("DELETE FROM \"", table_name, "\" WHERE ", key, " = ?;");
+    tmp_->on_conflict_update_sql = utils::StrCombine(
+        " ON CONFLICT( ", key, " ) DO ", updates.empty() ? "NOTHING" : updates);
+    std::string insert_sql = GetInsertStmtSql();
+    insert_sql.pop_back();  // Drop the trailing ';'
+    tmp_->upsert_stmt_sql =
+        utils::StrCombine(insert_sql, tmp_->on_conflict_update_sql, ";");
+  }
+
+  // Adds the FTS5 index, its sync triggers and its search query.
+  template <typename RowTuple>
+  void SetFullTextInfo() const {
+    if (tmp_->without_rowid) {
+      throw std::runtime_error(utils::StrCombine(
+          "Full-text columns need a rowid table: ", tmp_->table_name));
+    }
+    for (const auto& column_name : tmp_->full_text_columns) {
+      auto it = tmp_->column_name_to_index.find(column_name);
+      if (it == tmp_->column_name_to_index.end()) {
+        throw std::runtime_error(
+            utils::StrCombine("Unknown full-text column: ", column_name));
+      }
+      bool is_text = false;
+      magic::ForRange<0, std::tuple_size_v<RowTuple>>([&]<int I>() {
+        if (I == it->second) {
+          is_text = ToDataBaseType<std::tuple_element_t<I, RowTuple>>() == "TEXT";
+        }
+      });
+      if (!is_text) {
+        throw std::runtime_error(
+            utils::StrCombine("Full-text column is not TEXT: ", column_name));
+      }
+    }
+
+    const std::string& table_name = tmp_->table_name;
+    std::string fts               = utils::StrCombine(table_name, "_fts");
+    std::string columns           = utils::StrJoin(", ", tmp_->full_text_columns);
+    std::string new_values;
+    std::string old_values;
+    for (const auto& column_name : tmp_->full_text_columns) {
+      utils::StrAppend(new_values, ", new.", column_name);
+      utils::StrAppend(old_values, ", old.", column_name);
+    }
+    std::string insert_new = utils::StrCombine("INSERT INTO \"",
+                                               fts,
+                                               "\"( rowid, ",
+                                               columns,
+                                               " ) VALUES( new.rowid",
+                                               new_values,
+                                               " );");
+    std::string delete_old = utils::StrCombine("INSERT INTO \"",
+                                               fts,
+                                               "\"( \"",
+                                               fts,
+                                               "\", rowid, ",
+                                               columns,
+                                               " ) VALUES( 'delete', old.rowid",
+                                               old_values,
+                                               " );");
+    auto trigger = [&](std::string_view suffix, std::string_view event) {
+      return utils::StrCombine("CREATE TRIGGER IF NOT EXISTS \"",
+                               fts,
+                               suffix,
+                               "\" AFTER ",
+                               event,
+                               " ON \"",
+                               table_name,
+                               "\" BEGIN ");
+    };
+
+    std::string& sql = tmp_->ensure_table_sql;
+    utils::StrAppend(sql,
+                     "CREATE VIRTUAL TABLE IF NOT EXISTS \"",
+                     fts,
+                     "\" USING fts5( ",
+                     columns,
+                     ", content='",
+                     table_name,
+                     "' );");
+    utils::StrAppend(sql, trigger("_ai", "INSERT"), insert_new, " END;");
+    utils::StrAppend(sql, trigger("_ad", "DELETE"), delete_old, " END;");
+    utils::StrAppend(sql, trigger("_au", "UPDATE"), delete_old, insert_new, " END;");
+
+    tmp_->search_sql            = utils::StrCombine("SELECT t.* FROM \"",
+                                                    fts,
+                                                    "\" JOIN \"",
+                                                    table_name,
+                                                    "\" AS t ON t.rowid = \"",
+                                                    fts,
+                                                    "\".rowid WHERE \"",
+                                                    fts,
+                                                    "\" MATCH ? ORDER BY \"",
+                                                    fts,
+                                                    "\".rank LIMIT ?;");
+    tmp_->full_text_rebuild_sql = utils::StrCombine(
+        "INSERT INTO \"", fts, "\"( \"", fts, "\" ) VALUES( 'rebuild' );");
+    tmp_->full_text_table = std::move(fts);
+  }
+
   template <typename RowTuple>
   std::string GetEnsureTableSql() const {
     constexpr size_t column_size = std::tuple_size_v<RowTuple>;
 
-    std::vector<std::string> column_spec = {};
+    std::string sql =
+        utils::StrCombine("CREATE TABLE IF NOT EXISTS \"", tmp_->table_name, "\"( ");
     magic::ForRange<0, column_size>([&]<int I>() {
       using ColumnType = std::tuple_element_t<I, RowTuple>;
-      column_spec.push_back(
-          utils::StrCombine(tmp_->column_names[I], " ", ToDataBaseType<ColumnType>()));
+      std::string_view constraint = I == tmp_->primary_key_index ? " PRIMARY KEY" : "";
+      utils::StrAppend(sql,
+                       I == 0 ? "" : ", ",
+                       tmp_->column_names[I],
+                       " ",
+                       ToDataBaseType<ColumnType>(),
+                       constraint);
     });
+    sql += " )";
+    if (tmp_->strict) {
+      sql += " STRICT";
+    }
+    if (tmp_->without_rowid) {
+      sql += tmp_->strict ? ", WITHOUT ROWID" : " WITHOUT ROWID";
+    }
+    sql += ";";
+    return sql;
+  }
 
-    return utils::StrCombine("CREATE TABLE IF NOT EXISTS \"",
-                             tmp_->table_name,
-                             "\"( ",
-                             utils::StrJoin(", ", column_spec),
-                             " );");
+  // INSERT statement with one `?` parameter per column, for prepared-statement writers.
+  std::string GetInsertStmtSql() const {
+    std::string sql = utils::StrCombine("INSERT INTO \"", tmp_->table_name, "\" ( ");
+    utils::StrJoinTo(sql, ", ", tmp_->column_names);
+    sql += " ) VALUES( ";
+    for (size_t i = 0; i < tmp_->column_names.size(); ++i) {
+      sql += i == 0 ? "?" : ", ?";
+    }
+    sql += " );";
+    return sql;
   }
 
+  // Length of the INSERT of a row whose values average kValueSizeHint characters.
+  size_t GetInsertSQLSizeHint() const {
+    constexpr size_t kValueSizeHint = 16;
+    size_t size                     = tmp_->table_name.size() + 32;
+    for (const auto& column_name : tmp_->column_names) {
+      size += column_name.size() + kValueSizeHint + 4;
+    }
+    return size;
+  }
+
+  /*
+   * The returned function appends the literal INSERT of a row to a caller's buffer.
+   * Text values are quoted with embedded quotes doubled; std::string fields are
+   * copied in directly, other types go through ToDataBaseString.
+   */
   template <typename RowTuple>
-  std::function<std::string(const void* first_field_ref)> GetInsertSQLFunc() const {
-    constexpr size_t column_size    = std::tuple_size_v<RowTuple>;
-    std::string column_names_joined = utils::StrJoin(", ", tmp_->column_names);
+  AppendInsertSqlFunc GetAppendInsertSQLFunc() const {
+    constexpr size_t column_size = std::tuple_size_v<RowTuple>;
+    std::string prefix =
+        utils::StrCombine("INSERT INTO \"", tmp_->table_name, "\" ( ");
+    utils::StrJoinTo(prefix, ", ", tmp_->column_names);
+    prefix += " ) VALUES( ";
 
-    auto f = [table_name = tmp_->table_name,
-              column_names_joined](const void* first_field_ref) {
-      std::vector<std::string> column_values = {};
+    return [prefix = std::move(prefix)](const void* first_field_ref, std::string& out) {
+      out += prefix;
       magic::ForRange<0, column_size>([&]<int I>() {
-        using ColumnType  = std::tuple_element_t<I, RowTuple>;
-        std::string value = ToDataBaseString(*magic::GetAlignedRefByIndex<RowTuple, I>(
-            const_cast<void*>(first_field_ref)));
-        if constexpr (ToDataBaseType<ColumnType>() == "TEXT") {
-          value = utils::StrCombine("'", value, "'");
+        using ColumnType = std::tuple_element_t<I, RowTuple>;
+        const ColumnType& field =
+            *magic::GetAlignedRefByIndex<RowTuple, I>(const_cast<void*>(first_field_ref));
+        if constexpr (I > 0) {
+          out += ", ";
+        }
+        if constexpr (std::is_same_v<ColumnType, std::string>) {
+          utils::AppendSqlString(out, field);
+        } else if constexpr (ToDataBaseType<ColumnType>() == "TEXT") {
+          utils::AppendSqlString(out, ToDataBaseString(field));
+        } else {
+          out += ToDataBaseString(field);
         }
-        column_values.push_back(value);
       });
-
-      return utils::StrCombine("INSERT INTO \"",
-                               table_name,
-                               "\" ( ",
-                               column_names_joined,
-                               " ) VALUES( ",
-                               utils::StrJoin(", ", column_values),
-                               " );");
+      out += " );";
     };
-    return f;
   }
 
   std::unique_ptr<TableInfo> tmp_ = nullptr;
@@ -154,4 +439,17 @@ class SqlConstructorBuilder {
   void* first_field_ref_          = nullptr;
 };
 
+/*
+ * Returns a constructor for the table `table_name` shaped like the table of `base`,
+ * e.g. one partition of a partitioned table. Point it at a row with SetRef.
+ * @example WithTableName(GetDefaultSqliteHelper<Event>(), "Event_20261017")
+ */
+template <typename... ColumnTypes>
+SqlConstructor<std::tuple<ColumnTypes...>> WithTableName(
+    const SqlConstructor<std::tuple<ColumnTypes...>>& base,
+    const std::string& table_name) {
+  return SqlConstructorBuilder<ColumnTypes...>::BuildLike(base.GetTableInfo(),
+                                                          table_name);
+}
+
 }  // namespace sqliteol
\ No newline at end of file
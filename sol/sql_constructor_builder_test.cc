@@ -23,11 +23,144 @@ TEST(SqlConstructorBuilderTest, BuildSqlConstructor) {
   MyCustomType my_custom_type(111, "myname");
   auto sql_constructor = my_custom_type.sql_constructor();
   EXPECT_EQ(sql_constructor.GetEnsureTableSQL(),
-            "CREATE TABLE IF NOT EXISTS \"MyCustomType\"( id INT, name TEXT );");
+            "CREATE TABLE IF NOT EXISTS \"MyCustomType\"( id INTEGER, name TEXT );");
   EXPECT_EQ(sql_constructor.GetInsertSQL(),
             "INSERT INTO \"MyCustomType\" ( id, name ) VALUES( 111, 'myname' );");
 }
 
+TEST(SqlConstructorBuilderTest, PrimaryKey) {
+  struct KeyedType {
+    int id;
+    std::string name;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("KeyedType")
+          .AddColumn("id", &id)
+          .AddColumn("name", &name)
+          .SetPrimaryKey("id")
+          .Build();
+    };
+  };
+
+  auto sql_constructor = KeyedType{}.sql_constructor();
+  EXPECT_EQ(sql_constructor.GetEnsureTableSQL(),
+            "CREATE TABLE IF NOT EXISTS \"KeyedType\"( id INTEGER PRIMARY KEY, name TEXT "
+            ");");
+  EXPECT_EQ(sql_constructor.GetSelectByKeySQL(),
+            "SELECT * FROM \"KeyedType\" WHERE id = ?;");
+  EXPECT_EQ(sql_constructor.GetUpsertStmtSQL(),
+            "INSERT INTO \"KeyedType\" ( id, name ) VALUES( ?, ? ) ON CONFLICT( id ) DO "
+            "UPDATE SET name = excluded.name;");
+}
+
+TEST(SqlConstructorBuilderTest, StrictWithoutRowid) {
+  struct Sample {
+    int64_t time;
+    double value;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("Sample")
+          .AddColumn("time", &time)
+          .AddColumn("value", &value)
+          .SetPrimaryKey("time")
+          .SetStrict()
+          .SetWithoutRowid()
+          .Build();
+    };
+  };
+
+  struct Unkeyed {
+    int id;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("Unkeyed")
+          .AddColumn("id", &id)
+          .SetWithoutRowid()
+          .Build();
+    };
+  };
+
+  EXPECT_EQ(Sample{}.sql_constructor().GetEnsureTableSQL(),
+            "CREATE TABLE IF NOT EXISTS \"Sample\"( time INTEGER PRIMARY KEY, value REAL "
+            ") STRICT, WITHOUT ROWID;");
+  EXPECT_THROW(Unkeyed{}.sql_constructor(), std::runtime_error);
+}
+
+TEST(SqlConstructorBuilderTest, RejectsColumnsOutOfMemberOrder) {
+  struct Swapped {
+    int id;
+    std::string name;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("Swapped")
+          .AddColumn("name", &name)
+          .AddColumn("id", &id)
+          .Build();
+    };
+  };
+
+  struct Gap {
+    int id;
+    double skipped;
+    double value;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("Gap")
+          .AddColumn("id", &id)
+          .AddColumn("value", &value)
+          .Build();
+    };
+  };
+
+  EXPECT_THROW(Swapped{}.sql_constructor(), std::runtime_error);
+  EXPECT_THROW(Gap{}.sql_constructor(), std::runtime_error);
+}
+
+TEST(SqlConstructorBuilderTest, FullText) {
+  struct Note {
+    int id;
+    std::string text;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("Note")
+          .AddColumn("id", &id)
+          .AddColumn("text", &text)
+          .SetFullText("text")
+          .Build();
+    };
+  };
+
+  struct NumberIndexed {
+    int id;
+
+    auto sql_constructor() {
+      return SqlConstructorBuilder<>()
+          .SetTableName("NumberIndexed")
+          .AddColumn("id", &id)
+          .SetFullText("id")
+          .Build();
+    };
+  };
+
+  auto sql_constructor = Note{}.sql_constructor();
+  EXPECT_TRUE(sql_constructor.HasFullText());
+  EXPECT_EQ(sql_constructor.GetFullTextTableName(), "Note_fts");
+  EXPECT_THAT(sql_constructor.GetEnsureTableSQL(),
+              HasSubstr("CREATE VIRTUAL TABLE IF NOT EXISTS \"Note_fts\" USING fts5( "
+                        "text, content='Note' );"));
+  EXPECT_EQ(sql_constructor.GetSearchSQL(),
+            "SELECT t.* FROM \"Note_fts\" JOIN \"Note\" AS t ON t.rowid = "
+            "\"Note_fts\".rowid WHERE \"Note_fts\" MATCH ? ORDER BY \"Note_fts\".rank "
+            "LIMIT ?;");
+  EXPECT_THROW(NumberIndexed{}.sql_constructor(), std::runtime_error);
+}
+
 int main(int argc, char** argv) {
   ::testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();
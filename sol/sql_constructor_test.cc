@@ -22,9 +22,9 @@ TEST(SqlConstructorTest, BuildSqlConstructor) {
   };
   MyCustomType my_custom_type(1001, "myname", 180.5);
   auto sql_constructor = my_custom_type.sql_constructor();
-  EXPECT_EQ(
-      sql_constructor.GetEnsureTableSQL(),
-      "CREATE TABLE IF NOT EXISTS \"MyCustomType\"( id INT, name TEXT, heigh REAL );");
+  EXPECT_EQ(sql_constructor.GetEnsureTableSQL(),
+            "CREATE TABLE IF NOT EXISTS \"MyCustomType\"( id INTEGER, name TEXT, heigh "
+            "REAL );");
   EXPECT_EQ(sql_constructor.GetInsertSQL(),
             "INSERT INTO \"MyCustomType\" ( id, name, heigh ) VALUES( 1001, 'myname', "
             "180.500000 );");
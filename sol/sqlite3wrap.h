@@ -0,0 +1,306 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <concepts>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+#include "sol/logger.h"
+#include "sol/serialize_template.h"
+#include "sol/sqlite_interrupt.h"
+#include "sol/utils/str_utils.h"
+#include "sqlite3.h"
+
+/**
+ * @file
+ * Thin RAII wrappers around the raw sqlite3 C API used by the rest of the library.
+ */
+
+namespace sqliteol {
+
+/**
+ * @class SqliteError
+ * @brief Thrown when sqlite fails a call, with the result code it returned, e.g. to
+ *        tell SQLITE_BUSY apart without parsing the message.
+ */
+class SqliteError : public std::runtime_error {
+ public:
+  inline SqliteError(int code, const std::string& what)
+      : std::runtime_error(what), code_(code) {
+  }
+
+  // The result code, extended if the connection reports extended codes.
+  inline int code() const {
+    return code_;
+  }
+
+  // Whether the database or a table was locked by another connection.
+  inline bool IsBusy() const {
+    return (code_ & 0xff) == SQLITE_BUSY || (code_ & 0xff) == SQLITE_LOCKED;
+  }
+
+ private:
+  int code_;
+};
+
+namespace sqlite3wrap {
+
+struct DbDeleter {
+  inline void operator()(sqlite3* db) const {
+    if (db) {
+      sqlite3_close(db);
+    }
+  }
+};
+
+struct StmtDeleter {
+  inline void operator()(sqlite3_stmt* stmt) const {
+    if (stmt) {
+      sqlite3_finalize(stmt);
+    }
+  }
+};
+
+struct BlobDeleter {
+  inline void operator()(sqlite3_blob* blob) const {
+    if (blob) {
+      sqlite3_blob_close(blob);
+    }
+  }
+};
+
+struct BackupDeleter {
+  inline void operator()(sqlite3_backup* backup) const {
+    if (backup) {
+      sqlite3_backup_finish(backup);
+    }
+  }
+};
+
+using DbPtr     = std::unique_ptr<sqlite3, DbDeleter>;
+using StmtPtr   = std::unique_ptr<sqlite3_stmt, StmtDeleter>;
+using BlobPtr   = std::unique_ptr<sqlite3_blob, BlobDeleter>;
+using BackupPtr = std::unique_ptr<sqlite3_backup, BackupDeleter>;
+
+/*
+ * Opens `filename` read-write, creating it if needed. URI filenames such as
+ * "file:name?mode=memory&cache=shared" are accepted. A null `vfs` is the default
+ * VFS.
+ */
+inline DbPtr OpenDatabase(const char* filename,
+                          int flags = SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE |
+                                      SQLITE_OPEN_URI,
+                          const char* vfs = nullptr) {
+  sqlite3* db = nullptr;
+  int rc = sqlite3_open_v2(filename, &db, flags, vfs);
+  if (rc != SQLITE_OK) {
+    std::string error_message = db ? sqlite3_errmsg(db) : "out of memory";
+    sqlite3_close(db);
+    throw SqliteError(rc, utils::StrCombine("Failed to open database: ", error_message));
+  }
+  return DbPtr(db);
+}
+
+inline void ExecuteSql(sqlite3* db,
+                       const std::string& sql,
+                       int (*callback)(void*, int, char**, char**) = nullptr,
+                       void* data                                  = nullptr) {
+  char* err_msg = nullptr;
+  Logger::getInstance().debug("Executing SQL: " + sql);
+  int rc = sqlite3_exec(db, sql.c_str(), callback, data, &err_msg);
+  if (rc != SQLITE_OK) {
+    std::string error_message = "SQL execution failed: ";
+    if (err_msg) {
+      error_message += err_msg;
+      sqlite3_free(err_msg);
+    }
+    ThrowIfInterrupted(rc, error_message);
+    throw SqliteError(rc, error_message);
+  }
+}
+
+inline StmtPtr Prepare(sqlite3* db, std::string_view sql) {
+  sqlite3_stmt* stmt = nullptr;
+  Logger::getInstance().debug(utils::StrCombine("Preparing SQL: ", sql));
+  int rc =
+      sqlite3_prepare_v2(db, sql.data(), static_cast<int>(sql.size()), &stmt, nullptr);
+  if (rc != SQLITE_OK) {
+    std::string error_message =
+        utils::StrCombine("SQL prepare failed: ", sqlite3_errmsg(db));
+    ThrowIfInterrupted(rc, error_message);
+    throw SqliteError(rc, error_message);
+  }
+  return StmtPtr(stmt);
+}
+
+/*
+ * Steps `stmt` once. Returns true while a row is available and false once the
+ * statement is done; any other result code is turned into a SqliteError, or an
+ * InterruptedError if the statement was interrupted.
+ */
+inline bool Step(sqlite3_stmt* stmt) {
+  int rc = sqlite3_step(stmt);
+  if (rc == SQLITE_ROW) {
+    return true;
+  }
+  if (rc == SQLITE_DONE) {
+    return false;
+  }
+  std::string error_message =
+      utils::StrCombine("SQL step failed: ", sqlite3_errmsg(sqlite3_db_handle(stmt)));
+  ThrowIfInterrupted(rc, error_message);
+  throw SqliteError(rc, error_message);
+}
+
+/*
+ * Binds `value` to the 1-based parameter `index`. Integral and floating-point
+ * values are bound natively, strings as text, everything else through its
+ * ToDataBaseString form. sqlite keeps its own copy of text values.
+ */
+template <typename T>
+void BindValue(sqlite3_stmt* stmt, int index, const T& value) {
+  int rc = SQLITE_OK;
+  if constexpr (std::integral<T>) {
+    rc = sqlite3_bind_int64(stmt, index, static_cast<sqlite3_int64>(value));
+  } else if constexpr (std::floating_point<T>) {
+    rc = sqlite3_bind_double(stmt, index, static_cast<double>(value));
+  } else if constexpr (std::is_same_v<T, std::string> ||
+                       std::is_same_v<T, std::string_view>) {
+    rc = sqlite3_bind_text64(
+        stmt, index, value.data(), value.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+  } else {
+    std::string text = ToDataBaseString(value);
+    rc               = sqlite3_bind_text64(
+        stmt, index, text.data(), text.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+  }
+  if (rc != SQLITE_OK) {
+    throw std::runtime_error(utils::StrCombine("SQL bind failed: ",
+                                               sqlite3_errmsg(sqlite3_db_handle(stmt))));
+  }
+}
+
+/*
+ * Same as BindValue, but strings are bound without a copy, so `field` must stay
+ * alive and unchanged until the statement has been stepped. Meant for the fields
+ * of a row that is bound and then written at once.
+ */
+template <typename T>
+void BindField(sqlite3_stmt* stmt, int index, const T& field) {
+  if constexpr (std::is_same_v<T, std::string>) {
+    if (sqlite3_bind_text64(
+            stmt, index, field.data(), field.size(), SQLITE_STATIC, SQLITE_UTF8) !=
+        SQLITE_OK) {
+      throw std::runtime_error(utils::StrCombine(
+          "SQL bind failed: ", sqlite3_errmsg(sqlite3_db_handle(stmt))));
+    }
+  } else {
+    BindValue(stmt, index, field);
+  }
+}
+
+// Text of result column `index`; NULL values read as an empty string.
+inline std::string_view ColumnText(sqlite3_stmt* stmt, int index) {
+  const unsigned char* text = sqlite3_column_text(stmt, index);
+  if (!text) {
+    return {};
+  }
+  return std::string_view(reinterpret_cast<const char*>(text),
+                          static_cast<size_t>(sqlite3_column_bytes(stmt, index)));
+}
+
+/*
+ * Reads result column `index` into `field`. Integers and reals stored natively are
+ * read without a round trip through text, and strings are assigned in place so
+ * `field` keeps its capacity; everything else goes through FromDataBaseString.
+ */
+template <typename T>
+void ReadColumn(sqlite3_stmt* stmt, int index, T& field) {
+  if constexpr (std::integral<T>) {
+    if (sqlite3_column_type(stmt, index) == SQLITE_INTEGER) {
+      field = static_cast<T>(sqlite3_column_int64(stmt, index));
+      return;
+    }
+  } else if constexpr (std::floating_point<T>) {
+    int type = sqlite3_column_type(stmt, index);
+    if (type == SQLITE_FLOAT || type == SQLITE_INTEGER) {
+      field = static_cast<T>(sqlite3_column_double(stmt, index));
+      return;
+    }
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    field.assign(ColumnText(stmt, index));
+    return;
+  }
+  field = FromDataBaseString<T>(ColumnText(stmt, index));
+}
+
+inline void BindZeroBlob(sqlite3_stmt* stmt, int index, sqlite3_int64 size) {
+  if (sqlite3_bind_zeroblob64(stmt, index, static_cast<sqlite3_uint64>(size)) !=
+      SQLITE_OK) {
+    throw std::runtime_error(utils::StrCombine("SQL bind failed: ",
+                                               sqlite3_errmsg(sqlite3_db_handle(stmt))));
+  }
+}
+
+inline BlobPtr OpenBlob(sqlite3* db,
+                        const std::string& table_name,
+                        const std::string& column_name,
+                        sqlite3_int64 rowid,
+                        bool writable) {
+  sqlite3_blob* blob = nullptr;
+  if (sqlite3_blob_open(db,
+                        "main",
+                        table_name.c_str(),
+                        column_name.c_str(),
+                        rowid,
+                        writable ? 1 : 0,
+                        &blob) != SQLITE_OK) {
+    sqlite3_blob_close(blob);
+    throw std::runtime_error(
+        utils::StrCombine("Failed to open blob: ", sqlite3_errmsg(db)));
+  }
+  return BlobPtr(blob);
+}
+
+/*
+ * Copies the "main" database of `src` into `dst` with the online backup API,
+ * `pages_per_step` pages at a time. Between steps the source is unlocked for
+ * `step_pause`, so other connections keep making progress during a long copy.
+ */
+inline void Backup(sqlite3* src,
+                   sqlite3* dst,
+                   int pages_per_step,
+                   std::chrono::milliseconds step_pause) {
+  BackupPtr backup(sqlite3_backup_init(dst, "main", src, "main"));
+  if (!backup) {
+    throw std::runtime_error(
+        utils::StrCombine("Failed to start backup: ", sqlite3_errmsg(dst)));
+  }
+
+  while (true) {
+    int rc = sqlite3_backup_step(backup.get(), pages_per_step);
+    if (rc == SQLITE_DONE) {
+      break;
+    }
+    if (rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED) {
+      throw std::runtime_error(
+          utils::StrCombine("Backup step failed: ", sqlite3_errstr(rc)));
+    }
+    if (step_pause.count() > 0 || rc != SQLITE_OK) {
+      std::this_thread::sleep_for(std::max(step_pause, std::chrono::milliseconds(1)));
+    }
+  }
+
+  int rc = sqlite3_backup_finish(backup.release());
+  if (rc != SQLITE_OK) {
+    throw std::runtime_error(
+        utils::StrCombine("Backup failed: ", sqlite3_errstr(rc)));
+  }
+}
+
+}  // namespace sqlite3wrap
+}  // namespace sqliteol
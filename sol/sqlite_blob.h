@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "sol/sqlite3wrap.h"
+
+namespace sqliteol {
+
+/**
+ * @class BlobStream
+ * @brief Incremental access to a single BLOB/TEXT cell via sqlite3_blob_*.
+ *
+ * @details The value is never materialized as a whole: reads and writes go through
+ *          caller-sized chunks, so multi-megabyte documents can be piped to and from
+ *          files or sockets. A blob handle can not change the size of the value, so
+ *          writers preallocate it with zeroblob on insert (see
+ *          SqliteFile::InsertWithBlob). The stream keeps its connection alive.
+ */
+class BlobStream {
+ public:
+  static constexpr size_t kDefaultChunkSize = 64 * 1024;
+
+  inline BlobStream(std::shared_ptr<sqlite3> db,
+                    const std::string& table_name,
+                    const std::string& column_name,
+                    sqlite3_int64 rowid,
+                    bool writable)
+      : db_(std::move(db)),
+        blob_(sqlite3wrap::OpenBlob(
+            db_.get(), table_name, column_name, rowid, writable)) {
+  }
+
+  inline size_t Size() const {
+    return static_cast<size_t>(sqlite3_blob_bytes(blob_.get()));
+  }
+
+  /*
+   * Reads up to `buffer.size()` bytes starting at `offset` and returns the number of
+   * bytes actually read (less than requested only at the end of the value).
+   */
+  inline size_t Read(std::span<char> buffer, size_t offset) const {
+    size_t size = Size();
+    if (offset >= size) {
+      return 0;
+    }
+    size_t n = std::min(buffer.size(), size - offset);
+    if (sqlite3_blob_read(
+            blob_.get(), buffer.data(), static_cast<int>(n), static_cast<int>(offset)) !=
+        SQLITE_OK) {
+      throw std::runtime_error(
+          utils::StrCombine("Failed to read blob: ", sqlite3_errmsg(db_.get())));
+    }
+    return n;
+  }
+
+  /*
+   * Overwrites `data.size()` bytes starting at `offset`. The write must fit in the
+   * preallocated size of the value.
+   */
+  inline void Write(std::span<const char> data, size_t offset) {
+    if (offset + data.size() > Size()) {
+      throw std::runtime_error("Blob write past the end of the value");
+    }
+    if (sqlite3_blob_write(blob_.get(),
+                           data.data(),
+                           static_cast<int>(data.size()),
+                           static_cast<int>(offset)) != SQLITE_OK) {
+      throw std::runtime_error(
+          utils::StrCombine("Failed to write blob: ", sqlite3_errmsg(db_.get())));
+    }
+  }
+
+  // Moves the handle to the same column of another row without reopening it.
+  inline void Reopen(sqlite3_int64 rowid) {
+    if (sqlite3_blob_reopen(blob_.get(), rowid) != SQLITE_OK) {
+      throw std::runtime_error(
+          utils::StrCombine("Failed to reopen blob: ", sqlite3_errmsg(db_.get())));
+    }
+  }
+
+  // Streams the whole value into `out`, `chunk_size` bytes at a time.
+  inline void CopyTo(std::ostream& out, size_t chunk_size = kDefaultChunkSize) const {
+    std::vector<char> chunk(chunk_size);
+    size_t offset = 0;
+    while (size_t n = Read(chunk, offset)) {
+      out.write(chunk.data(), static_cast<std::streamsize>(n));
+      offset += n;
+    }
+  }
+
+  /*
+   * Fills the value from `in`, `chunk_size` bytes at a time, and returns the number
+   * of bytes written. Stops at the end of `in` or of the preallocated value.
+   */
+  inline size_t CopyFrom(std::istream& in, size_t chunk_size = kDefaultChunkSize) {
+    std::vector<char> chunk(chunk_size);
+    size_t size   = Size();
+    size_t offset = 0;
+    while (offset < size && in) {
+      in.read(chunk.data(),
+              static_cast<std::streamsize>(std::min(chunk_size, size - offset)));
+      size_t n = static_cast<size_t>(in.gcount());
+      if (n == 0) {
+        break;
+      }
+      Write(std::span<const char>(chunk.data(), n), offset);
+      offset += n;
+    }
+    return offset;
+  }
+
+ private:
+  std::shared_ptr<sqlite3> db_;
+  sqlite3wrap::BlobPtr blob_;
+};
+
+}  // namespace sqliteol
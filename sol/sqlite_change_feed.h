@@ -0,0 +1,317 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sqlite3.h"
+
+namespace sqliteol {
+
+enum class ChangeType {
+  kInsert,
+  kUpdate,
+  kDelete,
+};
+
+struct ChangeEvent {
+  ChangeType type;
+  sqlite3_int64 rowid;
+};
+
+/**
+ * @class ChangeFeed
+ * @brief Collects row changes of a database through sqlite3_update_hook and delivers
+ *        them to subscribers one committed transaction at a time.
+ *
+ * @details Changes are buffered while a transaction is open, dropped when it rolls
+ *          back, and handed to the subscribers of each touched table after it
+ *          commits, once the writing call has released the connection. The commit
+ *          hook runs before the COMMIT can still fail, so its batches are only held
+ *          back until the outcome is known: a COMMIT that fails and rolls back
+ *          drops them too. Only writes
+ *          made through connections the feed is attached to are seen: writes from
+ *          other processes, incremental blob writes and changes rolled back with
+ *          ROLLBACK TO a caller's Savepoint are not reported accurately. The
+ *          library's own writes drop the changes they undo (see DropPendingSince).
+ *
+ *          Independently of the hooks, the library's own keyed write paths report the
+ *          primary keys they wrote to key subscribers right after each write, or once
+ *          the transaction it belongs to has ended (see NotifyKeyWritten and
+ *          DeferKeyWritten), which is what write-through caches build on.
+ */
+class ChangeFeed {
+ public:
+  using Callback = std::function<void(const std::vector<ChangeEvent>& events)>;
+  // `key` points to a value of the primary key column's C++ type; nullptr means
+  // every row of the table may have changed.
+  using KeyCallback = std::function<void(const void* key)>;
+
+  inline int Subscribe(std::string_view table_name, Callback callback) {
+    std::lock_guard lock(mutex_);
+    int id = next_id_++;
+    subscribers_.emplace(id, Subscriber{std::string(table_name), std::move(callback)});
+    return id;
+  }
+
+  inline int SubscribeKeys(std::string_view table_name, KeyCallback callback) {
+    std::lock_guard lock(mutex_);
+    int id = next_id_++;
+    key_subscribers_.emplace(id,
+                             KeySubscriber{std::string(table_name), std::move(callback)});
+    key_subscriber_count_ = key_subscribers_.size();
+    return id;
+  }
+
+  inline void Unsubscribe(int id) {
+    std::lock_guard lock(mutex_);
+    subscribers_.erase(id);
+    key_subscribers_.erase(id);
+    key_subscriber_count_ = key_subscribers_.size();
+  }
+
+  // Lets write paths skip extracting keys nobody listens to.
+  inline bool HasKeySubscribers() const {
+    return key_subscriber_count_.load(std::memory_order_relaxed) > 0;
+  }
+
+  inline void NotifyKeyWritten(std::string_view table_name, const void* key) {
+    std::lock_guard lock(mutex_);
+    for (const auto& [id, subscriber] : key_subscribers_) {
+      if (subscriber.table_name == table_name) {
+        subscriber.callback(key);
+      }
+    }
+  }
+
+  /*
+   * Holds a key notification of the calling thread's open transaction back until
+   * the thread's next Flush, run once the transaction has ended, so a cache does not
+   * keep the old row that other threads read meanwhile. `key` is nullptr for every
+   * row of the table.
+   */
+  inline void DeferKeyWritten(std::string_view table_name,
+                              std::shared_ptr<const void> key) {
+    std::lock_guard lock(mutex_);
+    deferred_keys_[std::this_thread::get_id()].push_back(
+        DeferredKey{std::string(table_name), std::move(key)});
+  }
+
+  // Number of changes queued per table by the open transaction.
+  using PendingMark = std::unordered_map<std::string, size_t>;
+
+  /*
+   * Marks the changes queued so far, for DropPendingSince. Call it with the writer
+   * lock held, right before opening a savepoint.
+   */
+  inline PendingMark MarkPending() {
+    std::lock_guard lock(mutex_);
+    PendingMark mark;
+    for (const auto& [table_name, events] : pending_) {
+      mark.emplace(table_name, events.size());
+    }
+    return mark;
+  }
+
+  /*
+   * Drops the changes queued since `mark`, once ROLLBACK TO has undone them: it
+   * fires no rollback hook, so they would otherwise be delivered on COMMIT.
+   */
+  inline void DropPendingSince(const PendingMark& mark) {
+    std::lock_guard lock(mutex_);
+    for (auto& [table_name, events] : pending_) {
+      auto it = mark.find(table_name);
+      events.resize(it == mark.end() ? 0 : std::min(it->second, events.size()));
+    }
+  }
+
+  // Installs the hooks on `db`. The feed must outlive the connection.
+  inline void Attach(sqlite3* db) {
+    sqlite3_update_hook(db, &ChangeFeed::OnUpdate, this);
+    sqlite3_commit_hook(db, &ChangeFeed::OnCommit, this);
+    sqlite3_rollback_hook(db, &ChangeFeed::OnRollback, this);
+  }
+
+  /*
+   * Delivers the batches of every transaction committed so far; call it once the
+   * calling thread's write has released the writer connection. Batches reach the
+   * subscribers in commit order; callbacks may write to the database again.
+   */
+  inline void Flush() {
+    FlushDeferredKeys();
+    std::lock_guard delivery_lock(delivery_mutex_);
+    std::vector<std::pair<std::string, std::vector<ChangeEvent>>> committed;
+    std::vector<Subscriber> subscribers;
+    {
+      std::lock_guard lock(mutex_);
+      if (committing_thread_ == std::this_thread::get_id()) {
+        ConfirmCommittingLocked();
+      }
+      if (committed_.empty()) {
+        return;
+      }
+      committed.swap(committed_);
+      for (const auto& [id, subscriber] : subscribers_) {
+        subscribers.push_back(subscriber);
+      }
+    }
+
+    for (const auto& [table_name, events] : committed) {
+      for (const auto& subscriber : subscribers) {
+        if (subscriber.table_name == table_name) {
+          subscriber.callback(events);
+        }
+      }
+    }
+  }
+
+ private:
+  struct Subscriber {
+    std::string table_name;
+    Callback callback;
+  };
+
+  struct KeySubscriber {
+    std::string table_name;
+    KeyCallback callback;
+  };
+
+  struct DeferredKey {
+    std::string table_name;
+    std::shared_ptr<const void> key;
+  };
+
+  inline void FlushDeferredKeys() {
+    std::vector<DeferredKey> keys;
+    {
+      std::lock_guard lock(mutex_);
+      auto it = deferred_keys_.find(std::this_thread::get_id());
+      if (it == deferred_keys_.end()) {
+        return;
+      }
+      keys.swap(it->second);
+      deferred_keys_.erase(it);
+    }
+    for (const auto& [table_name, key] : keys) {
+      NotifyKeyWritten(table_name, key.get());
+    }
+  }
+
+  static inline void OnUpdate(void* self,
+                              int op,
+                              const char* /*db_name*/,
+                              const char* table_name,
+                              sqlite3_int64 rowid) {
+    auto* feed = static_cast<ChangeFeed*>(self);
+    ChangeType type =
+        op == SQLITE_INSERT
+            ? ChangeType::kInsert
+            : (op == SQLITE_DELETE ? ChangeType::kDelete : ChangeType::kUpdate);
+    std::lock_guard lock(feed->mutex_);
+    feed->ConfirmCommittingLocked();
+    feed->pending_[table_name].push_back(ChangeEvent{type, rowid});
+  }
+
+  static inline int OnCommit(void* self) {
+    auto* feed = static_cast<ChangeFeed*>(self);
+    std::lock_guard lock(feed->mutex_);
+    feed->ConfirmCommittingLocked();
+    for (auto& [table_name, events] : feed->pending_) {
+      if (!events.empty()) {
+        feed->committing_.emplace_back(table_name, std::move(events));
+      }
+    }
+    feed->pending_.clear();
+    feed->committing_thread_ = std::this_thread::get_id();
+    return 0;  // Never veto the commit
+  }
+
+  static inline void OnRollback(void* self) {
+    auto* feed = static_cast<ChangeFeed*>(self);
+    std::lock_guard lock(feed->mutex_);
+    if (feed->committing_thread_ != std::this_thread::get_id()) {
+      feed->ConfirmCommittingLocked();
+    }
+    feed->pending_.clear();
+    // Still staged: the COMMIT that staged them failed and is being rolled back.
+    feed->committing_.clear();
+  }
+
+  /*
+   * Moves the batches staged by the commit hook to committed_, once their COMMIT is
+   * known to have succeeded. Writes are serialized by the writer lock and the
+   * library rolls back a failed COMMIT before releasing it, so staged batches are
+   * final when the staging thread has released the lock, or when any hook but the
+   * rollback of their own transaction follows.
+   */
+  inline void ConfirmCommittingLocked() {
+    for (auto& batch : committing_) {
+      committed_.push_back(std::move(batch));
+    }
+    committing_.clear();
+  }
+
+  std::mutex mutex_;
+  std::recursive_mutex delivery_mutex_;
+  int next_id_ = 0;
+  std::unordered_map<int, Subscriber> subscribers_;
+  std::unordered_map<int, KeySubscriber> key_subscribers_;
+  std::atomic<size_t> key_subscriber_count_ = 0;
+  std::unordered_map<std::thread::id, std::vector<DeferredKey>> deferred_keys_;
+  std::unordered_map<std::string, std::vector<ChangeEvent>> pending_;
+  // Batches of the last COMMIT, until it is known to have succeeded.
+  std::vector<std::pair<std::string, std::vector<ChangeEvent>>> committing_;
+  std::thread::id committing_thread_;
+  std::vector<std::pair<std::string, std::vector<ChangeEvent>>> committed_;
+};
+
+/**
+ * @class ChangeSubscription
+ * @brief Keeps a ChangeFeed callback registered for as long as it lives.
+ */
+class ChangeSubscription {
+ public:
+  ChangeSubscription() = default;
+
+  inline ChangeSubscription(std::shared_ptr<ChangeFeed> feed, int id)
+      : feed_(std::move(feed)), id_(id) {
+  }
+
+  inline ChangeSubscription(ChangeSubscription&& other) noexcept
+      : feed_(std::move(other.feed_)), id_(other.id_) {
+  }
+
+  inline ChangeSubscription& operator=(ChangeSubscription&& other) noexcept {
+    if (this != &other) {
+      Reset();
+      feed_ = std::move(other.feed_);
+      id_   = other.id_;
+    }
+    return *this;
+  }
+
+  inline ~ChangeSubscription() {
+    Reset();
+  }
+
+  inline void Reset() {
+    if (feed_) {
+      feed_->Unsubscribe(id_);
+      feed_.reset();
+    }
+  }
+
+ private:
+  std::shared_ptr<ChangeFeed> feed_ = nullptr;
+  int id_                           = 0;
+};
+
+}  // namespace sqliteol
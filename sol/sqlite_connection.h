@@ -0,0 +1,488 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "sol/io_stats_vfs.h"
+#include "sol/sqlite3wrap.h"
+#include "sol/sqlite_interrupt.h"
+
+namespace sqliteol {
+
+/**
+ * @class ScopedStmt
+ * @brief A prepared statement borrowed from a Connection for one operation.
+ *
+ * @details Cached statements are reset and their bindings cleared on release, so an
+ *          unfinished read never keeps a transaction open; uncached statements are
+ *          finalized.
+ */
+class ScopedStmt {
+ public:
+  inline ScopedStmt(sqlite3_stmt* cached) : stmt_(cached) {
+  }
+
+  inline ScopedStmt(sqlite3wrap::StmtPtr owned)
+      : stmt_(owned.get()), owned_(std::move(owned)) {
+  }
+
+  ScopedStmt(const ScopedStmt&)            = delete;
+  ScopedStmt& operator=(const ScopedStmt&) = delete;
+
+  inline ~ScopedStmt() {
+    if (!owned_ && stmt_) {
+      sqlite3_reset(stmt_);
+      sqlite3_clear_bindings(stmt_);
+    }
+  }
+
+  inline sqlite3_stmt* get() const {
+    return stmt_;
+  }
+
+ private:
+  sqlite3_stmt* stmt_;
+  sqlite3wrap::StmtPtr owned_ = nullptr;
+};
+
+/**
+ * @class Connection
+ * @brief An open sqlite3 handle plus the prepared statements compiled on it.
+ *
+ * @details A Connection is used by one thread at a time. Statement caching is turned
+ *          off for connections that several threads may hit at once. Statements run
+ *          on it honor the calling thread's ScopedDeadline and retry a locked
+ *          database per `busy`.
+ */
+class Connection {
+ public:
+  inline Connection(sqlite3wrap::DbPtr db,
+                    bool cache_statements,
+                    const BusyPolicy& busy                             = {},
+                    std::shared_ptr<std::atomic<uint64_t>> busy_retries = nullptr)
+      : busy_{busy, std::move(busy_retries)},
+        db_(std::move(db)),
+        cache_statements_(cache_statements) {
+    sqlite3wrap::InstallInterruptHandlers(db_.get(), &busy_);
+  }
+
+  Connection(const Connection&)            = delete;
+  Connection& operator=(const Connection&) = delete;
+
+  inline sqlite3* get() const {
+    return db_.get();
+  }
+
+  // Returns `sql` compiled on this connection, reusing a cached statement if any.
+  inline ScopedStmt Prepare(const std::string& sql) {
+    if (!cache_statements_) {
+      return ScopedStmt(sqlite3wrap::Prepare(db_.get(), sql));
+    }
+    auto it = statements_.find(sql);
+    if (it == statements_.end()) {
+      it = statements_.emplace(sql, sqlite3wrap::Prepare(db_.get(), sql)).first;
+    }
+    return ScopedStmt(it->second.get());
+  }
+
+ private:
+  BusyHandlerState busy_;  // Used by the busy handler of db_, so declared before it
+  sqlite3wrap::DbPtr db_;
+  bool cache_statements_;
+  // Declared after db_ so statements are finalized before the handle is closed.
+  std::unordered_map<std::string, sqlite3wrap::StmtPtr> statements_;
+};
+
+/**
+ * @class ConnectionLease
+ * @brief A connection handed out by a ConnectionPool for the duration of one call.
+ *
+ * @details Writer leases hold the pool's writer lock until they are released or
+ *          destroyed, and then run the pool's after-write callback with the lock
+ *          released.
+ */
+class ConnectionLease {
+ public:
+  inline ConnectionLease(std::shared_ptr<Connection> connection,
+                         std::unique_lock<std::timed_mutex> lock = {},
+                         std::function<void()> on_release = nullptr)
+      : connection_(std::move(connection)),
+        lock_(std::move(lock)),
+        on_release_(std::move(on_release)) {
+  }
+
+  inline ~ConnectionLease() {
+    Release();
+  }
+
+  // Releases the writer lock ahead of destruction; the connection stays usable.
+  inline void Release() {
+    if (lock_.owns_lock()) {
+      lock_.unlock();
+    }
+    if (auto on_release = std::exchange(on_release_, nullptr)) {
+      on_release();
+    }
+  }
+
+  inline sqlite3* get() const {
+    return connection_->get();
+  }
+
+  inline Connection* operator->() const {
+    return connection_.get();
+  }
+
+  inline const std::shared_ptr<Connection>& connection() const {
+    return connection_;
+  }
+
+ private:
+  std::shared_ptr<Connection> connection_;
+  std::unique_lock<std::timed_mutex> lock_;
+  std::function<void()> on_release_;
+};
+
+enum class ConnectionMode {
+  // A fresh connection is opened for every call. Nothing is shared between calls.
+  kPerCall,
+  // Connections are kept open: one writer connection shared by all threads, and one
+  // query_only connection per reading thread, each with its own statement cache.
+  kCached,
+};
+
+struct ConnectionOptions {
+  ConnectionMode mode = ConnectionMode::kPerCall;
+  // Switches the database to WAL on first write, so readers never wait for writers.
+  bool wal = false;
+  // Retries of statements finding the database locked by another connection.
+  BusyPolicy busy = {};
+  // Opens database files through IoStatsVfs, see SqliteFile::GetIoStats.
+  bool io_stats = false;
+};
+
+/**
+ * @class ConnectionPool
+ * @brief Hands out the connections a SqliteFile runs its statements on.
+ *
+ * @details Writes are always serialized through the writer lock. In kCached mode the
+ *          writer connection is reused, and every reading thread gets its own cached
+ *          query_only connection, so concurrent readers never contend on a lock and
+ *          only pay the open cost once. In-memory databases are pinned to one
+ *          connection for their lifetime; named shared-cache ones still give each
+ *          reading thread its own connection in kCached mode.
+ *
+ *          Reader connections are opened like the writer, so that a read before the
+ *          first write finds the database file, and are kept query_only. A thread's
+ *          reader is closed when the thread exits, if the pool is owned by a
+ *          shared_ptr, and otherwise when the pool is destroyed.
+ *
+ *          While a thread has a transaction open (see PinTransaction), every lease it
+ *          acquires, reader or writer, is on the transaction's connection.
+ */
+class ConnectionPool : public std::enable_shared_from_this<ConnectionPool> {
+ public:
+  inline ConnectionPool(std::string filename, const ConnectionOptions& options)
+      : filename_(std::move(filename)), options_(options) {
+    in_memory_      = filename_ == ":memory:" || IsSharedMemoryUri(filename_);
+    private_memory_ = filename_ == ":memory:";
+    if (in_memory_) {
+      // The pinned connection may be used by several readers at once.
+      pinned_ = std::make_shared<Connection>(sqlite3wrap::OpenDatabase(filename_.c_str()),
+                                             false,
+                                             options_.busy,
+                                             busy_retries_);
+    }
+  }
+
+  ConnectionPool(const ConnectionPool&)            = delete;
+  ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+  inline const std::string& filename() const {
+    return filename_;
+  }
+
+  inline bool IsInMemory() const {
+    return in_memory_;
+  }
+
+  inline ConnectionLease AcquireWriter() {
+    if (auto pinned = PinnedTransaction()) {
+      return ConnectionLease(std::move(pinned));
+    }
+    std::unique_lock lock(writer_mutex_, std::defer_lock);
+    LockWriter(lock);
+    if (in_memory_) {
+      return ConnectionLease(pinned_, std::move(lock), after_write_);
+    }
+    if (options_.mode == ConnectionMode::kPerCall) {
+      return ConnectionLease(OpenWriter(false), std::move(lock), after_write_);
+    }
+    if (!writer_) {
+      writer_ = OpenWriter(true);
+    }
+    return ConnectionLease(writer_, std::move(lock), after_write_);
+  }
+
+  /*
+   * Routes every lease the calling thread acquires to `connection` until
+   * UnpinTransaction. The caller keeps holding its writer lease meanwhile.
+   */
+  inline void PinTransaction(std::shared_ptr<Connection> connection) {
+    std::thread::id id = std::this_thread::get_id();
+    std::lock_guard lock(transactions_mutex_);
+    if (!transactions_.emplace(id, std::move(connection)).second) {
+      throw std::runtime_error(
+          "A transaction is already open on this thread, use a Savepoint to nest");
+    }
+    transaction_count_.fetch_add(1, std::memory_order_release);
+  }
+
+  inline void UnpinTransaction() {
+    std::lock_guard lock(transactions_mutex_);
+    if (transactions_.erase(std::this_thread::get_id()) > 0) {
+      transaction_count_.fetch_sub(1, std::memory_order_release);
+    }
+  }
+
+  inline bool InTransaction() const {
+    return PinnedTransaction() != nullptr;
+  }
+
+  /*
+   * Runs `initializer` on every writer connection of the pool, the ones already open
+   * and the ones opened later. Objects the initializer hands to sqlite (hook
+   * contexts, ...) must be kept alive by the initializer itself.
+   */
+  inline void AddWriterInitializer(std::function<void(sqlite3* db)> initializer) {
+    std::lock_guard lock(writer_mutex_);
+    if (pinned_) {
+      initializer(pinned_->get());
+    }
+    if (writer_) {
+      initializer(writer_->get());
+    }
+    writer_initializers_.push_back(std::move(initializer));
+  }
+
+  /*
+   * Runs `initializer` on every connection of the pool, readers included, the ones
+   * already open and the ones opened later. It may run concurrently with statements
+   * of other threads on the connection, so it should only add to the connection
+   * (functions, collations, ...), as sqlite serializes those calls.
+   */
+  inline void AddConnectionInitializer(std::function<void(sqlite3* db)> initializer) {
+    std::lock_guard writer_lock(writer_mutex_);
+    std::unique_lock lock(initializers_mutex_);
+    if (pinned_) {
+      initializer(pinned_->get());
+    }
+    if (writer_) {
+      initializer(writer_->get());
+    }
+    {
+      std::unique_lock readers_lock(readers_mutex_);
+      for (const auto& [id, reader] : readers_) {
+        initializer(reader->get());
+      }
+    }
+    connection_initializers_.push_back(std::move(initializer));
+  }
+
+  // Sets the callback every writer lease runs once it has released the writer lock.
+  inline void SetAfterWrite(std::function<void()> after_write) {
+    std::lock_guard lock(writer_mutex_);
+    after_write_ = std::move(after_write);
+  }
+
+  inline ConnectionLease AcquireReader() {
+    if (auto pinned = PinnedTransaction()) {
+      return ConnectionLease(std::move(pinned));
+    }
+    ScopedDeadline::ThrowIfExpired();
+    if (private_memory_ || (in_memory_ && options_.mode == ConnectionMode::kPerCall)) {
+      return ConnectionLease(pinned_);
+    }
+    if (options_.mode == ConnectionMode::kPerCall) {
+      return ConnectionLease(Open(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, false));
+    }
+
+    std::thread::id id = std::this_thread::get_id();
+    {
+      std::shared_lock lock(readers_mutex_);
+      auto it = readers_.find(id);
+      if (it != readers_.end()) {
+        return ConnectionLease(it->second);
+      }
+    }
+    // Held until the reader is listed, so AddConnectionInitializer cannot miss it.
+    std::shared_lock initializers_lock(initializers_mutex_);
+    auto reader = OpenLocked(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, true);
+    sqlite3wrap::ExecuteSql(reader->get(), "PRAGMA query_only = ON;");
+    {
+      std::unique_lock lock(readers_mutex_);
+      readers_.emplace(id, reader);
+    }
+    reader_reclaimer_.Add(weak_from_this());
+    return ConnectionLease(std::move(reader));
+  }
+
+  // Retries the busy handlers of the pool's connections have made so far.
+  inline uint64_t BusyRetries() const {
+    return busy_retries_->load(std::memory_order_relaxed);
+  }
+
+  // Number of cached reader connections, one per live thread that has read.
+  inline size_t ReaderCount() {
+    std::shared_lock lock(readers_mutex_);
+    return readers_.size();
+  }
+
+  /*
+   * Opens a connection that is not shared with any other call, for handles that
+   * outlive a single call such as blob streams. Private in-memory databases only
+   * have their pinned connection.
+   */
+  inline std::shared_ptr<Connection> OpenDedicated() {
+    if (private_memory_) {
+      return pinned_;
+    }
+    return Open(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, false);
+  }
+
+ private:
+  /*
+   * Closes the cached readers a thread opened once it exits, in the pools that still
+   * exist, so threads coming and going do not pile connections up.
+   */
+  class ReaderReclaimer {
+   public:
+    inline void Add(std::weak_ptr<ConnectionPool> pool) {
+      std::erase_if(pools_, [](const auto& known) { return known.expired(); });
+      pools_.push_back(std::move(pool));
+    }
+
+    inline ~ReaderReclaimer() {
+      for (const auto& known : pools_) {
+        if (auto pool = known.lock()) {
+          pool->DropReader(std::this_thread::get_id());
+        }
+      }
+    }
+
+   private:
+    std::vector<std::weak_ptr<ConnectionPool>> pools_;
+  };
+
+  inline void DropReader(std::thread::id id) {
+    std::shared_ptr<Connection> reader;
+    std::unique_lock lock(readers_mutex_);
+    auto it = readers_.find(id);
+    if (it != readers_.end()) {
+      reader = std::move(it->second);
+      readers_.erase(it);
+    }
+    lock.unlock();  // The connection is closed outside the lock
+  }
+
+  inline std::shared_ptr<Connection> PinnedTransaction() const {
+    if (transaction_count_.load(std::memory_order_acquire) == 0) {
+      return nullptr;
+    }
+    std::lock_guard lock(transactions_mutex_);
+    auto it = transactions_.find(std::this_thread::get_id());
+    return it == transactions_.end() ? nullptr : it->second;
+  }
+
+  /*
+   * Takes the writer lock, giving up with InterruptedError when the calling thread's
+   * ScopedDeadline expires first.
+   */
+  inline static void LockWriter(std::unique_lock<std::timed_mutex>& lock) {
+    if (!ScopedDeadline::IsActive()) {
+      lock.lock();
+      return;
+    }
+    // Short slices, so a cancellation also ends the wait.
+    ScopedDeadline::ThrowIfExpired();
+    while (!lock.try_lock_for(std::chrono::milliseconds(2))) {
+      ScopedDeadline::ThrowIfExpired();
+    }
+  }
+
+  static inline bool IsSharedMemoryUri(const std::string& filename) {
+    return filename.starts_with("file:") &&
+           filename.find("mode=memory") != std::string::npos;
+  }
+
+  inline std::shared_ptr<Connection> Open(int flags, bool cache_statements) {
+    std::shared_lock lock(initializers_mutex_);
+    return OpenLocked(flags, cache_statements);
+  }
+
+  // Open, for callers holding initializers_mutex_.
+  inline std::shared_ptr<Connection> OpenLocked(int flags, bool cache_statements) {
+    const char* vfs = options_.io_stats ? IoStatsVfs::Register() : nullptr;
+    auto connection = std::make_shared<Connection>(
+        sqlite3wrap::OpenDatabase(filename_.c_str(), flags | SQLITE_OPEN_URI, vfs),
+        cache_statements,
+        options_.busy,
+        busy_retries_);
+    for (const auto& initializer : connection_initializers_) {
+      initializer(connection->get());
+    }
+    return connection;
+  }
+
+  inline std::shared_ptr<Connection> OpenWriter(bool cache_statements) {
+    auto connection = Open(SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, cache_statements);
+    if (options_.wal) {
+      sqlite3wrap::ExecuteSql(connection->get(), "PRAGMA journal_mode = WAL;");
+    }
+    for (const auto& initializer : writer_initializers_) {
+      initializer(connection->get());
+    }
+    return connection;
+  }
+
+  std::string filename_;
+  ConnectionOptions options_;
+  // Declared before the connections whose busy handlers count into it.
+  std::shared_ptr<std::atomic<uint64_t>> busy_retries_ =
+      std::make_shared<std::atomic<uint64_t>>(0);
+  bool in_memory_      = false;
+  bool private_memory_ = false;
+
+  std::shared_ptr<Connection> pinned_ = nullptr;  // In-memory databases only
+
+  std::timed_mutex writer_mutex_;
+  std::shared_ptr<Connection> writer_ = nullptr;  // kCached mode only
+  std::vector<std::function<void(sqlite3* db)>> writer_initializers_;
+  std::function<void()> after_write_ = nullptr;
+
+  mutable std::mutex transactions_mutex_;
+  std::atomic<size_t> transaction_count_ = 0;  // Lets leases skip the lookup
+  std::unordered_map<std::thread::id, std::shared_ptr<Connection>> transactions_;
+
+  // Locked after writer_mutex_ and before readers_mutex_.
+  std::shared_mutex initializers_mutex_;
+  std::vector<std::function<void(sqlite3* db)>> connection_initializers_;
+
+  std::shared_mutex readers_mutex_;
+  std::unordered_map<std::thread::id, std::shared_ptr<Connection>> readers_;
+
+  inline static thread_local ReaderReclaimer reader_reclaimer_;
+};
+
+}  // namespace sqliteol
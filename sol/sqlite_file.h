@@ -1,143 +1,1485 @@
 #pragma once
 
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <exception>
 #include <filesystem>
 #include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
+#include "sol/export_format.h"
+#include "sol/import_format.h"
 #include "sol/logger.h"
+#include "sol/query_plan.h"
+#include "sol/storage_stats.h"
 #include "sol/sql_constructor_builder.h"
+#include "sol/sqlite3wrap.h"
+#include "sol/sqlite_blob.h"
+#include "sol/sqlite_change_feed.h"
+#include "sol/sqlite_connection.h"
+#include "sol/sqlite_function.h"
+#include "sol/sqlite_transaction.h"
+#include "sol/utils/bounded_queue.h"
+#include "sol/utils/buffered_writer.h"
+#include "sol/utils/mapped_file.h"
+#include "sol/utils/sql_buffer.h"
 #include "sol/utils/str_utils.h"
 #include "sqlite3.h"
 
 namespace sqliteol {
 
-namespace sqlite3wrap {
+template <typename T>
+concept HasSqliteHelper = requires { GetDefaultSqliteHelper<T>(); };
 
-struct DbDeleter {
-  inline void operator()(sqlite3* db) const {
-    if (db) {
-      sqlite3_close(db);
-    }
-  }
+/**
+ * @struct BackupOptions
+ * @brief Pacing of an online backup between two SqliteFiles.
+ *
+ * @details Pages are copied `pages_per_step` at a time and the source is released
+ *          for `step_pause` between steps, so a snapshot of a large database does not
+ *          stall the readers and writers of the source.
+ */
+struct BackupOptions {
+  int pages_per_step                   = 256;
+  std::chrono::milliseconds step_pause = std::chrono::milliseconds(0);
 };
 
-using DbPtr = std::unique_ptr<sqlite3, DbDeleter>;
+/*
+ * What MergeFrom and CopyTable do with a source row whose primary key (or other
+ * unique constraint) already exists in the destination.
+ */
+enum class ConflictPolicy {
+  kAbort,    // Fail and copy nothing
+  kIgnore,   // Keep the destination row
+  kReplace,  // Delete the destination row and insert the source row
+  kUpdate,   // Overwrite the destination row's columns; needs a primary key
+};
+
+// The typed statements Explain<T> can report the plan of.
+enum class TypedQuery {
+  kGetTable,
+  kGet,
+  kGetByKeys,
+  kUpsert,
+  kDelete,
+};
+
+/**
+ * @struct ImportOptions
+ * @brief Input format and parallelism of SqliteFile::Import.
+ *
+ * @details CSV fields are matched to columns by the header record when `csv_header`
+ *          is set, and by position otherwise. NDJSON members are matched by key.
+ *          Fields without a column are ignored, columns without a field keep the
+ *          value of a default-constructed T.
+ */
+struct ImportOptions {
+  ImportFormat format = ImportFormat::kCsv;
+  bool csv_header     = true;
+  char csv_delimiter  = ',';
+  // Parsing threads; 0 uses std::thread::hardware_concurrency().
+  size_t threads = 0;
+  // Rows handed to the writer, and committed, at a time.
+  size_t batch_rows = 8192;
+};
+
+/**
+ * @struct ExportOptions
+ * @brief Output format and buffering of SqliteFile::Export.
+ */
+struct ExportOptions {
+  ExportFormat format = ExportFormat::kCsv;
+  char csv_delimiter  = ',';
+  // Bytes collected before each write to the file.
+  size_t buffer_size = 1 << 20;
+};
+
+/**
+ * @class RowDecoder
+ * @brief Decodes result rows of a statement into T through its sql_constructor.
+ *
+ * @details The constructor is built once and pointed at an internal scratch row, so
+ *          decoding a row costs one FromDataBaseString per column plus a copy.
+ */
+template <HasSqliteHelper T>
+class RowDecoder {
+ public:
+  using Constructor = decltype(std::declval<T&>().sql_constructor());
+
+  static constexpr int column_size_ = Constructor::column_size_;
+
+  inline RowDecoder() : sql_constructor_(row_.sql_constructor()) {
+    sql_constructor_.SetRef(&row_);
+  }
+
+  RowDecoder(const RowDecoder&)            = delete;
+  RowDecoder& operator=(const RowDecoder&) = delete;
 
-inline DbPtr OpenDatabase(const char* filename) {
-  sqlite3* db = nullptr;
-  if (sqlite3_open(filename, &db) != SQLITE_OK) {
-    throw std::runtime_error(
-        utils::StrCombine("Failed to open database: ", sqlite3_errmsg(db)));
+  // Decodes the current row of `stmt`, reading columns from `first_column` on.
+  inline const T& Decode(sqlite3_stmt* stmt, int first_column = 0) {
+    DecodeInto(stmt, row_, first_column);
+    return row_;
   }
-  return DbPtr(db);
-}
 
-inline void ExecuteSql(sqlite3* db,
-                       const std::string& sql,
-                       int (*callback)(void*, int, char**, char**) = nullptr,
-                       void* data                                  = nullptr) {
-  char* err_msg = nullptr;
-  Logger::getInstance().debug("Executing SQL: " + sql);
-  if (sqlite3_exec(db, sql.c_str(), callback, data, &err_msg) != SQLITE_OK) {
-    std::string error_message = "SQL execution failed: ";
-    if (err_msg) {
-      error_message += err_msg;
-      sqlite3_free(err_msg);
+  // Same as Decode, but writes straight into `row`, e.g. a new element of a result.
+  inline void DecodeInto(sqlite3_stmt* stmt, T& row, int first_column = 0) {
+    if (sqlite3_column_count(stmt) - first_column != column_size_) {
+      throw std::runtime_error("Column size mismatch");
     }
-    throw std::runtime_error(error_message);
+    sql_constructor_.SetRef(&row);
+    magic::ForRange<0, column_size_>([&]<int I>() {
+      sqlite3wrap::ReadColumn(
+          stmt, first_column + I, sql_constructor_.template FieldRef<I>());
+    });
   }
-}
 
-}  // namespace sqlite3wrap
+ private:
+  T row_{};
+  Constructor sql_constructor_;
+};
 
-template <typename T>
-concept HasSqliteHelper = requires { GetDefaultSqliteHelper<T>(); };
+template <HasSqliteHelper T>
+class PartitionedTable;
 
+/**
+ * @class SqliteFile
+ * @brief Typed access to one SQLite database.
+ *
+ * @details Every method may be called concurrently from several threads on the same
+ *          SqliteFile (copies share their connections). Writes (EnsureTable,
+ *          DropTable, Insert*, RestoreFrom) are serialized through one writer lock;
+ *          reads (GetTable, BackupTo, read-only OpenBlob) never take it. With the
+ *          default ConnectionMode::kPerCall every call opens its own connection; with
+ *          ConnectionMode::kCached connections and their prepared statements are kept
+ *          per thread, which is what lets many readers scale, especially together
+ *          with `wal`. Streams returned by OpenBlob must stay on one thread and do
+ *          not see uncommitted changes of a Transaction.
+ */
 class SqliteFile {
  public:
-  inline SqliteFile(const std::filesystem::path& path) : path_(path) {
+  static constexpr std::string_view kMemoryPath = ":memory:";
+
+  /*
+   * Opens the database at `path`. Passing ":memory:" gives a private in-memory
+   * database that lives as long as this SqliteFile and its copies.
+   */
+  inline SqliteFile(const std::filesystem::path& path,
+                    const ConnectionOptions& options = {})
+      : path_(path),
+        pool_(std::make_shared<ConnectionPool>(path.string(), options)),
+        change_feed_(std::make_shared<ChangeFeed>()),
+        change_feed_attached_(std::make_shared<std::once_flag>()),
+        query_check_(std::make_shared<std::atomic<QueryCheck>>(QueryCheck::kOff)) {
+  }
+
+  /*
+   * Creates an in-memory database with the same typed API as a file. With an empty
+   * `shared_name` the database is private to this SqliteFile; otherwise it is the
+   * shared-cache database "file:<shared_name>?mode=memory&cache=shared", which other
+   * connections in the process can open by the same name.
+   */
+  inline static SqliteFile InMemory(std::string_view shared_name = "",
+                                    const ConnectionOptions& options = {}) {
+    if (shared_name.empty()) {
+      return SqliteFile(std::filesystem::path(kMemoryPath), options);
+    }
+    return SqliteFile(std::filesystem::path(utils::StrCombine(
+                          "file:", shared_name, "?mode=memory&cache=shared")),
+                      options);
+  }
+
+  // Creates an in-memory database and fills it with the content of `disk_path`.
+  inline static SqliteFile LoadIntoMemory(const std::filesystem::path& disk_path,
+                                          const BackupOptions& options = {}) {
+    SqliteFile file = InMemory();
+    file.RestoreFrom(SqliteFile(disk_path), options);
+    return file;
+  }
+
+  inline bool IsInMemory() const {
+    return pool_->IsInMemory();
+  }
+
+  inline const std::filesystem::path& path() const {
+    return path_;
+  }
+
+  /*
+   * Writes a consistent snapshot of this database into `destination`, replacing its
+   * content. The copy is incremental (see BackupOptions) and may run while other
+   * threads keep using this SqliteFile.
+   */
+  inline void BackupTo(const SqliteFile& destination,
+                       const BackupOptions& options = {}) const {
+    auto src = pool_->AcquireReader();
+    auto dst = destination.pool_->AcquireWriter();
+    sqlite3wrap::Backup(src.get(), dst.get(), options.pages_per_step, options.step_pause);
+  }
+
+  // Replaces the content of this database with a snapshot of `source`.
+  inline void RestoreFrom(const SqliteFile& source, const BackupOptions& options = {}) {
+    source.BackupTo(*this, options);
+  }
+
+  // Returns the plan SQLite picks for `sql`, without running it.
+  inline QueryPlan Explain(std::string_view sql) {
+    auto db = pool_->AcquireReader();
+    return sqlite3wrap::ExplainQueryPlan(db.get(), sql);
+  }
+
+  /*
+   * Returns the plan of the statement `query` runs for T, e.g. to assert in a test
+   * that Get<T> searches an index instead of scanning the table.
+   */
+  template <HasSqliteHelper T>
+  QueryPlan Explain(TypedQuery query) {
+    auto& helper = GetDefaultSqliteHelper<T>();
+    if (query != TypedQuery::kGetTable) {
+      RequirePrimaryKey(helper);
+    }
+    switch (query) {
+      case TypedQuery::kGetTable:
+        return Explain(
+            utils::StrCombine("SELECT * FROM \"", helper.GetTableName(), "\";"));
+      case TypedQuery::kGet:
+        return Explain(helper.GetSelectByKeySQL());
+      case TypedQuery::kGetByKeys:
+        return Explain(helper.GetSelectByKeysSQL());
+      case TypedQuery::kUpsert:
+        return Explain(helper.GetUpsertStmtSQL());
+      case TypedQuery::kDelete:
+        return Explain(helper.GetDeleteByKeySQL());
+    }
+    throw std::runtime_error("Unknown TypedQuery");
+  }
+
+  /*
+   * Turns on checking of Query, Search and the keyed operations (Get, GetByKeys,
+   * Upsert, Delete): when one of their statements steps through a full table scan or
+   * sorts through a temporary B-tree, typically because the table lacks the index a
+   * query or primary key needs, it is logged or thrown (see QueryCheck). GetTable,
+   * Export and PartitionedTable::Scan read whole tables by design and are not
+   * checked. Meant for tests and debug builds.
+   */
+  inline void SetQueryCheck(QueryCheck check) {
+    query_check_->store(check, std::memory_order_relaxed);
+  }
+
+  // Page counts of the database and the space of every table and index.
+  inline StorageStats GetStorageStats() {
+    auto db = pool_->AcquireReader();
+    return sqlite3wrap::ReadStorageStats(db.get());
+  }
+
+  /*
+   * I/O counters of the database file and of its journal or WAL, counted since the
+   * process started by every connection opened on them with
+   * ConnectionOptions::io_stats. Empty for in-memory databases and for files no such
+   * connection opened.
+   *
+   * Example usage:
+   *   for (const FileIoStats& file : db_file.GetIoStats()) {
+   *     log(file.path, file.syncs, file.sync_time, file.max_sync_time);
+   *   }
+   */
+  inline std::vector<FileIoStats> GetIoStats() const {
+    if (IsInMemory()) {
+      return {};
+    }
+    std::error_code error;
+    std::string database = std::filesystem::weakly_canonical(path_, error).string();
+    std::vector<FileIoStats> stats;
+    for (FileIoStats& file : IoStatsVfs::Snapshot()) {
+      if (file.path == database || file.path == database + "-journal" ||
+          file.path == database + "-wal" || file.path == database + "-shm") {
+        stats.push_back(std::move(file));
+      }
+    }
+    return stats;
+  }
+
+  /*
+   * Retries made so far by the busy handlers of this file's connections, which wait
+   * out locks held by other connections per ConnectionOptions::busy.
+   */
+  inline uint64_t GetBusyRetries() const {
+    return pool_->BusyRetries();
+  }
+
+  /*
+   * Switches the database to auto_vacuum = INCREMENTAL, so that IncrementalVacuum can
+   * return free pages to the file system. A database that already holds tables is
+   * restructured by one full VACUUM, so call this when it is created. The VACUUM may
+   * renumber the rowids of tables without an INTEGER PRIMARY KEY, so the full-text
+   * indexes, which refer to rows by rowid, are rebuilt after it.
+   */
+  inline void EnableIncrementalVacuum() {
+    constexpr int64_t kIncremental = 2;
+    auto db                        = pool_->AcquireWriter();
+    if (sqlite3wrap::PragmaInt(db.get(), "auto_vacuum") == kIncremental) {
+      return;
+    }
+    sqlite3wrap::ExecuteSql(db.get(), "PRAGMA auto_vacuum = INCREMENTAL;");
+    if (sqlite3wrap::PragmaInt(db.get(), "auto_vacuum") != kIncremental) {
+      sqlite3wrap::ExecuteSql(db.get(), "VACUUM;");
+      RebuildFullTextIndexes(db.get());
+    }
+  }
+
+  /*
+   * Returns free pages to the file system, `pages_per_step` pages per short write
+   * transaction, until the freelist is empty or `budget` has elapsed, and returns
+   * the number of pages released. Other writers get the lock between steps, so a
+   * large cleanup can run in the background without a blocking VACUUM. Releases
+   * nothing unless EnableIncrementalVacuum was called.
+   */
+  inline int64_t IncrementalVacuum(std::chrono::milliseconds budget,
+                                   int pages_per_step = 64) {
+    auto deadline    = std::chrono::steady_clock::now() + budget;
+    int64_t released = 0;
+    std::string sql  = utils::StrCombine(
+        "PRAGMA incremental_vacuum(", std::to_string(pages_per_step), ");");
+    do {
+      auto db        = pool_->AcquireWriter();
+      int64_t before = sqlite3wrap::PragmaInt(db.get(), "freelist_count");
+      if (before == 0) {
+        break;
+      }
+      sqlite3wrap::ExecuteSql(db.get(), sql);
+      int64_t after = sqlite3wrap::PragmaInt(db.get(), "freelist_count");
+      released += before - after;
+      if (after == before) {
+        break;  // Not in incremental auto-vacuum mode
+      }
+    } while (std::chrono::steady_clock::now() < deadline);
+    return released;
+  }
+
+  /*
+   * Runs PRAGMA optimize, which re-analyzes the tables whose planner statistics are
+   * likely stale. Cheap enough to run periodically, e.g. after large imports.
+   */
+  inline void Optimize() {
+    auto db = pool_->AcquireWriter();
+    sqlite3wrap::ExecuteSql(db.get(), "PRAGMA optimize;");
+  }
+
+  // Recomputes the planner statistics of every table and index.
+  inline void Analyze() {
+    auto db = pool_->AcquireWriter();
+    sqlite3wrap::ExecuteSql(db.get(), "ANALYZE;");
+  }
+
+  /*
+   * Makes `func` callable from SQL as the deterministic scalar function `name`, on
+   * every connection of this file, so filters and projections using it run inside
+   * SQLite. Arguments are converted to the parameter types of `func` and its result
+   * back to an SQL value: integers and floating points natively, std::string and
+   * std::string_view as text, std::optional<T> maps NULL, other types go through
+   * their database string. An exception thrown by `func` fails the statement with
+   * its message. `func` may be called from several threads at once.
+   *
+   * Example usage:
+   *   db_file.RegisterFunction("bucket", [](int64_t v) { return v / 100; });
+   *   db_file.Query<Count>("SELECT bucket(x) AS b, COUNT(*) FROM T GROUP BY b;");
+   */
+  template <typename Func>
+  void RegisterFunction(const std::string& name, Func func) {
+    auto shared = std::make_shared<Func>(std::move(func));
+    AddFunction(name, [name, shared](sqlite3* db) {
+      sqlite3wrap::CreateScalarFunction(db, name, shared);
+    });
+  }
+
+  /*
+   * Makes an aggregate callable from SQL as `name`. Each group starts from a copy of
+   * `initial`, `step(State& state, args...)` is called for each of its rows and the
+   * result is `finalize(const State& state)`, also for an empty group. Argument and
+   * result conversions are those of RegisterFunction.
+   *
+   * Example usage:
+   *   db_file.RegisterAggregate(
+   *       "product", 1.0, [](double& p, double v) { p *= v; },
+   *       [](const double& p) { return p; });
+   */
+  template <typename State, typename Step, typename Finalize>
+  void RegisterAggregate(const std::string& name,
+                         State initial,
+                         Step step,
+                         Finalize finalize) {
+    auto shared = std::make_shared<sqlite3wrap::AggregateFunction<State, Step, Finalize>>(
+        std::move(initial), std::move(step), std::move(finalize));
+    AddFunction(name, [name, shared](sqlite3* db) {
+      sqlite3wrap::CreateAggregateFunction(db, name, shared);
+    });
+  }
+
+  /*
+   * Copies the rows of T's table in `from` into T's table in `to`, creating it if
+   * needed, and returns the number of rows written. See MergeFrom.
+   */
+  template <HasSqliteHelper T>
+  static size_t CopyTable(const SqliteFile& from,
+                          SqliteFile& to,
+                          ConflictPolicy policy = ConflictPolicy::kAbort) {
+    if (from.pool_->filename() == kMemoryPath) {
+      throw std::runtime_error(
+          "Private in-memory databases cannot be attached, use a shared name");
+    }
+    return to.MergeFrom<T>(from.pool_->filename(), policy);
+  }
+
+  /*
+   * Copies the rows of the tables of Ts from the database at `source` into this one
+   * and returns the number of rows written. The source is ATTACHed to the writer
+   * connection and every table is copied with one INSERT ... SELECT, so values never
+   * leave SQLite. All tables are copied in one transaction; tables missing from the
+   * source are skipped, missing ones here are created. Cannot be called inside a
+   * Transaction, as SQLite does not attach databases within one.
+   *
+   * Example usage:
+   *   for (const auto& host_db : host_dbs) {
+   *     merged.MergeFrom<Event, Metric>(host_db, ConflictPolicy::kIgnore);
+   *   }
+   */
+  template <HasSqliteHelper... Ts>
+  size_t MergeFrom(const std::filesystem::path& source,
+                   ConflictPolicy policy = ConflictPolicy::kAbort) {
+    static_assert(sizeof...(Ts) > 0, "MergeFrom needs at least one table type");
+    if (pool_->InTransaction()) {
+      throw std::runtime_error("MergeFrom cannot run inside a transaction");
+    }
+
+    size_t copied = 0;
+    {
+      auto db = pool_->AcquireWriter();
+      {
+        auto attach = sqlite3wrap::Prepare(db.get(), "ATTACH DATABASE ? AS sol_source;");
+        sqlite3wrap::BindValue(attach.get(), 1, source.string());
+        sqlite3wrap::Step(attach.get());
+      }
+      try {
+        sqlite3wrap::ExecuteSql(db.get(), "BEGIN IMMEDIATE;");
+        try {
+          ((copied += CopyAttachedTable<Ts>(db.get(), policy)), ...);
+          sqlite3wrap::ExecuteSql(db.get(), "COMMIT;");
+        } catch (...) {
+          sqlite3_exec(db.get(), "ROLLBACK;", nullptr, nullptr, nullptr);
+          throw;
+        }
+      } catch (...) {
+        sqlite3_exec(db.get(), "DETACH DATABASE sol_source;", nullptr, nullptr, nullptr);
+        throw;
+      }
+      sqlite3wrap::ExecuteSql(db.get(), "DETACH DATABASE sol_source;");
+    }
+    (NotifyTableWritten(GetDefaultSqliteHelper<Ts>().GetTableName()), ...);
+    return copied;
+  }
+
+  /*
+   * Opens a transaction that every typed operation made by the calling thread joins
+   * until it ends (see Transaction).
+   *
+   * Example usage:
+   *   Transaction transaction = db_file.BeginTransaction(TransactionMode::kImmediate);
+   *   db_file.Insert(row);
+   *   db_file.InsertRows(rows);
+   *   transaction.Commit();
+   */
+  inline Transaction BeginTransaction(
+      TransactionMode mode = TransactionMode::kDeferred) {
+    return Transaction(pool_, mode);
+  }
+
+  // Runs `func` inside a transaction, committing when it returns normally.
+  template <typename Func>
+  auto InTransaction(Func&& func, TransactionMode mode = TransactionMode::kDeferred) {
+    Transaction transaction = BeginTransaction(mode);
+    if constexpr (std::is_void_v<std::invoke_result_t<Func>>) {
+      std::forward<Func>(func)();
+      transaction.Commit();
+    } else {
+      auto result = std::forward<Func>(func)();
+      transaction.Commit();
+      return result;
+    }
+  }
+
+  // Whether the calling thread has a transaction open on this database.
+  inline bool IsInTransaction() const {
+    return pool_->InTransaction();
   }
 
   template <HasSqliteHelper T>
   void EnsureTable() {
-    const std::string& sql = GetDefaultSqliteHelper<T>().GetEnsureTableSQL();
-    auto db                = sqlite3wrap::OpenDatabase(path_.c_str());
-    sqlite3wrap::ExecuteSql(db.get(), sql);
+    EnsureTable(GetDefaultSqliteHelper<T>());
+  }
+
+  /*
+   * The overloads taking a `table` constructor work on the table it names instead of
+   * T's own, e.g. a copy of T's table under another name (see WithTableName).
+   */
+  template <typename RowTuple>
+  void EnsureTable(const SqlConstructor<RowTuple>& table) {
+    auto db = pool_->AcquireWriter();
+    EnsureTableOn(db.get(), table);
+  }
+
+  /*
+   * Creates the tables of all Ts that do not exist yet, in a single transaction. A
+   * fingerprint of the schemas is recorded in the "sol_schema_fingerprints" table,
+   * so once a database has been bootstrapped with the same set of types, later
+   * calls only look the fingerprint up and write nothing. DropTable forgets all
+   * fingerprints; tables dropped by other means are not noticed. Full-text indexes
+   * are rebuilt whenever the fingerprint is new.
+   *
+   * Example usage:
+   *   db_file.EnsureTables<User, Order, Event>();
+   */
+  template <HasSqliteHelper... Ts>
+  void EnsureTables() {
+    uint64_t hash = utils::Fnv1a64("");
+    ((hash = utils::Fnv1a64(GetDefaultSqliteHelper<Ts>().GetEnsureTableSQL(), hash)),
+     ...);
+    auto fingerprint = static_cast<sqlite3_int64>(hash);
+
+    auto db = pool_->AcquireWriter();
+    if (HasSchemaFingerprint(*db.connection(), fingerprint)) {
+      return;
+    }
+    AtomicWrite write = StartAtomicWrite(db.get(), "sol_ensure_tables");
+    std::string sql   = utils::StrCombine(
+        write.begin,
+        GetDefaultSqliteHelper<Ts>().GetEnsureTableSQL()...,
+        GetDefaultSqliteHelper<Ts>().GetFullTextRebuildSQL()...,
+        "CREATE TABLE IF NOT EXISTS sol_schema_fingerprints"
+        "( fingerprint INTEGER PRIMARY KEY );",
+        "INSERT OR IGNORE INTO sol_schema_fingerprints VALUES( ",
+        std::to_string(fingerprint),
+        " );",
+        write.end);
+    try {
+      sqlite3wrap::ExecuteSql(db.get(), sql);
+    } catch (...) {
+      UndoAtomicWrite(db.get(), write);
+      throw;
+    }
   }
 
   template <HasSqliteHelper T>
   void DropTable() {
-    std::string_view table_name = GetDefaultSqliteHelper<T>().GetTableName();
+    DropTable(GetDefaultSqliteHelper<T>());
+  }
+
+  /*
+   * Drops `table` and, unless `forget_fingerprints` is false, the schema fingerprints
+   * EnsureTables recorded, so that it runs its DDL again. Tables EnsureTables never
+   * creates (partitions, ...) can keep them.
+   */
+  template <typename RowTuple>
+  void DropTable(const SqlConstructor<RowTuple>& table, bool forget_fingerprints = true) {
+    std::string_view table_name = table.GetTableName();
     std::string sql = utils::StrCombine("DROP TABLE IF EXISTS \"", table_name, "\";");
-    auto db         = sqlite3wrap::OpenDatabase(path_.c_str());
-    sqlite3wrap::ExecuteSql(db.get(), sql);
+    if (forget_fingerprints) {
+      utils::StrAppend(sql, "DROP TABLE IF EXISTS sol_schema_fingerprints;");
+    }
+    if (table.HasFullText()) {
+      utils::StrAppend(
+          sql, "DROP TABLE IF EXISTS \"", table.GetFullTextTableName(), "\";");
+    }
+    {
+      auto db = pool_->AcquireWriter();
+      sqlite3wrap::ExecuteSql(db.get(), sql);
+    }
+    NotifyTableWritten(table_name);
   }
 
   template <HasSqliteHelper T>
   std::vector<T> GetTable() {
+    return GetTable<T>(GetDefaultSqliteHelper<T>());
+  }
+
+  template <HasSqliteHelper T>
+  std::vector<T> GetTable(const typename RowDecoder<T>::Constructor& table) {
+    return QueryRows<T>(
+        utils::StrCombine("SELECT * FROM \"", table.GetTableName(), "\";"), false);
+  }
+
+  /*
+   * Runs the SELECT `sql` and decodes every result row into T, so its columns must
+   * match T's in number and order.
+   *
+   * Example usage:
+   *   auto users = db_file.Query<User>("SELECT * FROM User WHERE age > 30;");
+   */
+  template <HasSqliteHelper T>
+  std::vector<T> Query(const std::string& sql) {
+    return QueryRows<T>(sql, true);
+  }
+
+  /*
+   * Full-text search over the columns T marks with SetFullText: returns the rows
+   * matching the FTS5 `query`, best match (bm25) first, at most `limit` of them.
+   *
+   * Example usage:
+   *   auto hits = db_file.Search<Article>("sqlite AND (index OR fts)", 10);
+   */
+  template <HasSqliteHelper T>
+  std::vector<T> Search(std::string_view query, int limit = 20) {
+    auto& helper = GetDefaultSqliteHelper<T>();
+    if (!helper.HasFullText()) {
+      throw std::runtime_error(
+          utils::StrCombine("Table has no full-text columns: ", helper.GetTableName()));
+    }
     std::vector<T> result;
+    RowDecoder<T> decoder;
+    auto db   = pool_->AcquireReader();
+    auto stmt = db->Prepare(helper.GetSearchSQL());
+    sqlite3wrap::BindValue(stmt.get(), 1, query);
+    sqlite3wrap::BindValue(stmt.get(), 2, limit);
+    while (sqlite3wrap::Step(stmt.get())) {
+      decoder.DecodeInto(stmt.get(), result.emplace_back());
+    }
+    CheckStatement(stmt.get());
+    return result;
+  }
+
+  // Names of the tables in the database, sorted.
+  inline std::vector<std::string> GetTableNames() {
+    std::vector<std::string> names;
+    auto db   = pool_->AcquireReader();
+    auto stmt = db->Prepare(
+        "SELECT name FROM sqlite_master WHERE type = 'table' ORDER BY name;");
+    while (sqlite3wrap::Step(stmt.get())) {
+      names.emplace_back(sqlite3wrap::ColumnText(stmt.get(), 0));
+    }
+    return names;
+  }
+
+  template <HasSqliteHelper T>
+  void Insert(T& row) {
+    Insert(row, row.sql_constructor());
+  }
+
+  template <HasSqliteHelper T>
+  void Insert(T& row, const typename RowDecoder<T>::Constructor& table) {
+    auto helper = table;
+    helper.SetRef(&row);
+    {
+      utils::SqlBuffer sql;
+      helper.AppendInsertSQL(sql.str());
+      auto db = pool_->AcquireWriter();
+      sqlite3wrap::ExecuteSql(db.get(), sql.str());
+    }
+    NotifyKeyWritten(helper);
+  }
+
+  /*
+   * Inserts all `rows` atomically. Outside a Transaction they are committed at once;
+   * inside one they become part of it. `sync_off` skips the fsyncs of this batch
+   * only: the connection's previous synchronous setting is restored afterwards.
+   */
+  template <HasSqliteHelper T>
+  void InsertRows(std::vector<T>& rows, bool sync_off = false) {
+    InsertRows(rows, GetDefaultSqliteHelper<T>(), sync_off);
+  }
+
+  template <HasSqliteHelper T>
+  void InsertRows(std::vector<T>& rows,
+                  const typename RowDecoder<T>::Constructor& table,
+                  bool sync_off = false) {
+    if (rows.empty()) {
+      return;
+    }
+    auto helper = table;
+    {
+      utils::SqlBuffer buffer;
+      std::string& sql = buffer.str();
+      sql.reserve(rows.size() * helper.GetInsertSQLSizeHint() + 64);
+      for (auto& row : rows) {
+        helper.SetRef(&row);
+        helper.AppendInsertSQL(sql);
+      }
+
+      auto db           = pool_->AcquireWriter();
+      AtomicWrite write = StartAtomicWrite(db.get(), "sol_insert_rows");
+      sql += write.end;
+      // The writer connection may be reused by later calls (kCached).
+      std::string restore_sync;
+      if (sync_off) {
+        restore_sync = utils::StrCombine(
+            "PRAGMA synchronous = ",
+            std::to_string(sqlite3wrap::PragmaInt(db.get(), "synchronous")),
+            ";");
+      }
+      try {
+        sqlite3wrap::ExecuteSql(
+            db.get(),
+            utils::StrCombine(sync_off ? "PRAGMA synchronous = OFF;" : "", write.begin));
+        sqlite3wrap::ExecuteSql(db.get(), sql);
+      } catch (...) {
+        UndoAtomicWrite(db.get(), write);
+        if (sync_off) {
+          sqlite3_exec(db.get(), restore_sync.c_str(), nullptr, nullptr, nullptr);
+        }
+        throw;
+      }
+      if (sync_off) {
+        sqlite3wrap::ExecuteSql(db.get(), restore_sync);
+      }
+    }
+    for (auto& row : rows) {
+      helper.SetRef(&row);
+      NotifyKeyWritten(helper);
+    }
+  }
+
+  /*
+   * Bulk-loads the CSV or NDJSON file at `path` into T's table and returns the number
+   * of rows imported. The file is memory-mapped and cut into pieces at record
+   * boundaries; worker threads parse the pieces into T in parallel, and the calling
+   * thread inserts the parsed batches through one prepared statement, committing
+   * every batch (see ImportOptions). Rows of different pieces may be inserted in any
+   * order. If parsing or inserting fails, no batch is inserted after the failure, the
+   * batches committed before it are kept and the error is rethrown; call Import
+   * inside a Transaction to keep none of them.
+   *
+   * Example usage:
+   *   db_file.EnsureTable<User>();
+   *   size_t rows = db_file.Import<User>("users.csv");
+   */
+  template <HasSqliteHelper T>
+  size_t Import(const std::filesystem::path& path, const ImportOptions& options = {}) {
+    utils::MappedFile file(path);
+    std::string_view data     = file.data();
+    auto& helper              = GetDefaultSqliteHelper<T>();
+    const auto& names         = helper.GetColumnNames();
+    constexpr int column_size = RowDecoder<T>::column_size_;
+
+    // Column of every CSV field, -1 for fields without a column.
+    std::vector<int> csv_columns;
+    if (options.format == ImportFormat::kCsv) {
+      std::string scratch;
+      if (options.csv_header) {
+        import_format::ParseCsvRecord(
+            data, options.csv_delimiter, scratch, [&](int, std::string_view name) {
+              csv_columns.push_back(helper.GetColumnIndex(name).value_or(-1));
+            });
+      } else {
+        for (int i = 0; i < column_size; ++i) {
+          csv_columns.push_back(i);
+        }
+      }
+    }
+
+    size_t threads = options.threads;
+    if (threads == 0) {
+      threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    size_t batch_rows = std::max<size_t>(options.batch_rows, 1);
+    // More pieces than threads, so a slow piece does not leave the others idle.
+    std::vector<std::string_view> pieces =
+        import_format::SplitRecords(data, threads * 4, options.format);
+    threads = std::min(threads, std::max<size_t>(pieces.size(), 1));
+
+    utils::BoundedQueue<std::vector<T>> batches(threads * 2);
+    std::atomic<size_t> next_piece = 0;
+    std::atomic<size_t> running    = threads;
+    std::atomic<bool> failed       = false;
+    std::mutex error_mutex;
+    std::exception_ptr error = nullptr;
+
+    auto fail = [&](std::exception_ptr exception) {
+      std::lock_guard lock(error_mutex);
+      if (!error) {
+        error = exception;
+      }
+      failed = true;
+      batches.Close();
+    };
+
+    auto parse = [&] {
+      try {
+        T row;
+        auto constructor = row.sql_constructor();
+        constructor.SetRef(&row);
+        std::string scratch;
+        std::string value_scratch;
+        std::vector<T> batch;
+        batch.reserve(batch_rows);
+
+        auto on_csv_field = [&](int index, std::string_view value) {
+          if (index < static_cast<int>(csv_columns.size()) && csv_columns[index] >= 0) {
+            constructor.SetFieldByIndex(csv_columns[index], value);
+          }
+        };
+        auto on_json_field = [&](std::string_view key,
+                                 std::optional<std::string_view> value) {
+          if (!value.has_value()) {
+            return;
+          }
+          for (int i = 0; i < column_size; ++i) {
+            if (names[i] == key) {
+              constructor.SetFieldByIndex(i, *value);
+              break;
+            }
+          }
+        };
+
+        for (size_t i = next_piece++; i < pieces.size(); i = next_piece++) {
+          std::string_view piece = pieces[i];
+          while (true) {
+            row = T{};
+            bool parsed = options.format == ImportFormat::kCsv
+                              ? import_format::ParseCsvRecord(
+                                    piece, options.csv_delimiter, scratch, on_csv_field)
+                              : import_format::ParseJsonRecord(
+                                    piece, scratch, value_scratch, on_json_field);
+            if (!parsed) {
+              break;
+            }
+            batch.push_back(row);
+            if (batch.size() == batch_rows) {
+              if (!batches.Push(std::move(batch))) {
+                return;
+              }
+              batch.clear();
+              batch.reserve(batch_rows);
+            }
+          }
+        }
+        if (!batch.empty()) {
+          batches.Push(std::move(batch));
+        }
+      } catch (...) {
+        fail(std::current_exception());
+      }
+      if (--running == 0) {
+        batches.Close();
+      }
+    };
+
+    std::vector<std::thread> workers;
+    try {
+      for (size_t i = 0; i < threads; ++i) {
+        workers.emplace_back(parse);
+      }
+    } catch (...) {
+      // The closed queue stops the workers already started.
+      batches.Close();
+      for (auto& worker : workers) {
+        worker.join();
+      }
+      throw;
+    }
+
+    size_t imported = 0;
+    try {
+      // Batches still queued when a worker fails are dropped, not inserted.
+      while (std::optional<std::vector<T>> batch = batches.Pop()) {
+        if (failed) {
+          break;
+        }
+        imported += InsertBatch(*batch);
+      }
+    } catch (...) {
+      fail(std::current_exception());
+    }
+    for (auto& worker : workers) {
+      worker.join();
+    }
+    if (error) {
+      std::rethrow_exception(error);
+    }
+    return imported;
+  }
+
+  /*
+   * Streams T's table into the file at `path`, replacing it once the export has
+   * succeeded, and returns the number of rows written. Values are encoded straight
+   * from the statement, without building T, into a fixed-size write buffer, so
+   * memory use does not grow with the table. The export reads one consistent
+   * snapshot of the table.
+   *
+   * Example usage:
+   *   db_file.Export<User>("users.bin", {.format = ExportFormat::kBinary});
+   */
+  template <HasSqliteHelper T>
+  size_t Export(const std::filesystem::path& path, const ExportOptions& options = {}) {
     auto& helper    = GetDefaultSqliteHelper<T>();
     std::string sql = utils::StrCombine("SELECT * FROM \"", helper.GetTableName(), "\";");
 
-    T row;
-    auto sql_constructor = row.sql_constructor();
-    sql_constructor.SetRef(&row);
+    // Written next to `path` and renamed over it once complete, so a failed export
+    // leaves neither a truncated file nor a missing previous one.
+    std::filesystem::path partial = path;
+    partial += ".partial";
+    size_t rows = 0;
+    try {
+      utils::BufferedFileWriter out(partial, options.buffer_size);
+      auto db        = pool_->AcquireReader();
+      auto stmt      = db->Prepare(sql);
+      int columns    = sqlite3_column_count(stmt.get());
+      bool csv       = options.format == ExportFormat::kCsv;
+      char delimiter = options.csv_delimiter;
 
-    using CData = std::tuple<T*, decltype(sql_constructor)*, std::vector<T>*>;
-    CData data_to_sqlc{&row, &sql_constructor, &result};
-    constexpr int column_size = decltype(sql_constructor)::column_size_;
+      std::vector<std::string_view> column_names;
+      for (int i = 0; i < columns; ++i) {
+        column_names.emplace_back(sqlite3_column_name(stmt.get(), i));
+      }
+      if (csv) {
+        for (int i = 0; i < columns; ++i) {
+          if (i > 0) {
+            out.Append(delimiter);
+          }
+          export_format::AppendCsvField(out, column_names[i], delimiter);
+        }
+        out.Append('\n');
+      } else {
+        export_format::AppendBinaryHeader(out, column_names);
+      }
 
-    auto db = sqlite3wrap::OpenDatabase(path_.c_str());
-    sqlite3wrap::ExecuteSql(
-        db.get(),
-        sql,
-        [](void* data, int argc, char** argv, char** col_name) {
-          auto [row, sql_constructor, result] = *static_cast<CData*>(data);
-          if (argc != column_size) {
-            throw std::runtime_error("Column size mismatch");
+      while (sqlite3wrap::Step(stmt.get())) {
+        if (csv) {
+          for (int i = 0; i < columns; ++i) {
+            if (i > 0) {
+              out.Append(delimiter);
+            }
+            export_format::AppendCsvColumn(out, stmt.get(), i, delimiter);
+          }
+          out.Append('\n');
+        } else {
+          for (int i = 0; i < columns; ++i) {
+            export_format::AppendBinaryColumn(out, stmt.get(), i);
           }
+        }
+        ++rows;
+      }
+      out.Close();
+      std::filesystem::rename(partial, path);
+    } catch (...) {
+      std::error_code ignored;
+      std::filesystem::remove(partial, ignored);
+      throw;
+    }
+    return rows;
+  }
 
-          magic::ForRange<0, column_size>(
-              [&]<int I>() { sql_constructor->template SetFieldByIndex<I>(argv[I]); });
+  /*
+   * Inserts `row` with `blob_column` preallocated as a zeroblob of `blob_size` bytes
+   * instead of its in-memory value, and returns the rowid of the new row. Fill the
+   * value afterwards through OpenBlob(blob_column, rowid, true).
+   */
+  template <HasSqliteHelper T>
+  sqlite3_int64 InsertWithBlob(T& row,
+                               std::string_view blob_column,
+                               sqlite3_int64 blob_size) {
+    auto helper               = row.sql_constructor();
+    std::optional<int> column = helper.GetColumnIndex(blob_column);
+    if (!column.has_value()) {
+      throw std::runtime_error(utils::StrCombine("Unknown column: ", blob_column));
+    }
 
-          result->push_back(*row);
-          return 0;
-        },
-        &data_to_sqlc);
-    return result;
+    constexpr int column_size = decltype(helper)::column_size_;
+    sqlite3_int64 rowid       = 0;
+    {
+      auto db   = pool_->AcquireWriter();
+      auto stmt = db->Prepare(helper.GetInsertStmtSQL());
+      magic::ForRange<0, column_size>([&]<int I>() {
+        if (I == *column) {
+          sqlite3wrap::BindZeroBlob(stmt.get(), I + 1, blob_size);
+        } else {
+          sqlite3wrap::BindField(stmt.get(), I + 1, helper.template GetFieldByIndex<I>());
+        }
+      });
+      sqlite3wrap::Step(stmt.get());
+      rowid = sqlite3_last_insert_rowid(db.get());
+    }
+    NotifyKeyWritten(helper);
+    return rowid;
   }
 
-  template <HasSqliteHelper T>
-  void Insert(T& row) {
-    auto helper     = row.sql_constructor();
-    std::string sql = helper.GetInsertSQL();
+  // Looks a row up by the primary key declared with SetPrimaryKey.
+  template <HasSqliteHelper T, typename Key>
+  std::optional<T> Get(const Key& key) {
+    auto& helper = GetDefaultSqliteHelper<T>();
+    RequirePrimaryKey(helper);
+
+    RowDecoder<T> decoder;
+    auto db   = pool_->AcquireReader();
+    auto stmt = db->Prepare(helper.GetSelectByKeySQL());
+    sqlite3wrap::BindValue(stmt.get(), 1, key);
+    bool found = sqlite3wrap::Step(stmt.get());
+    CheckStatement(stmt.get());
+    if (!found) {
+      return std::nullopt;
+    }
+    return decoder.Decode(stmt.get());
+  }
+
+  /*
+   * Looks up many rows by primary key with a single query and returns them in the
+   * order of `keys`, with std::nullopt for keys that have no row. The keys are bound
+   * as one JSON array and joined through the json_each table-valued function, so
+   * no SQL text grows with the number of keys. `keys` is any contiguous range;
+   * infinite floating-point keys are found, NaN keys never are.
+   */
+  template <HasSqliteHelper T, std::ranges::contiguous_range Keys>
+  std::vector<std::optional<T>> GetByKeys(const Keys& keys) {
+    auto& helper = GetDefaultSqliteHelper<T>();
+    RequirePrimaryKey(helper);
+
+    std::vector<std::optional<T>> result(std::ranges::size(keys));
+    if (result.empty()) {
+      return result;
+    }
 
-    auto db = sqlite3wrap::OpenDatabase(path_.c_str());
-    sqlite3wrap::ExecuteSql(db.get(), sql.c_str());
+    std::string keys_json = ToJsonArray(keys);
+    RowDecoder<T> decoder;
+    auto db   = pool_->AcquireReader();
+    auto stmt = db->Prepare(helper.GetSelectByKeysSQL());
+    sqlite3wrap::BindValue(stmt.get(), 1, keys_json);
+    while (sqlite3wrap::Step(stmt.get())) {
+      result[sqlite3_column_int64(stmt.get(), 0)] = decoder.Decode(stmt.get(), 1);
+    }
+    CheckStatement(stmt.get());
+    return result;
   }
 
+  // Inserts `row`, or updates every column of the row with the same primary key.
   template <HasSqliteHelper T>
-  void InsertRows(std::vector<T>& rows, bool sync_off = false) {
-    if (rows.empty()) {
+  void Upsert(T& row) {
+    auto helper = row.sql_constructor();
+    RequirePrimaryKey(helper);
+    {
+      auto db   = pool_->AcquireWriter();
+      auto stmt = db->Prepare(helper.GetUpsertStmtSQL());
+      BindRow(stmt.get(), helper);
+      sqlite3wrap::Step(stmt.get());
+      CheckStatement(stmt.get());
+    }
+    NotifyKeyWritten(helper);
+  }
+
+  // Deletes the row with primary key `key`, if any.
+  template <HasSqliteHelper T, typename Key>
+  void Delete(const Key& key) {
+    auto& helper = GetDefaultSqliteHelper<T>();
+    RequirePrimaryKey(helper);
+    {
+      auto db   = pool_->AcquireWriter();
+      auto stmt = db->Prepare(helper.GetDeleteByKeySQL());
+      sqlite3wrap::BindValue(stmt.get(), 1, key);
+      sqlite3wrap::Step(stmt.get());
+      CheckStatement(stmt.get());
+    }
+    if (!change_feed_->HasKeySubscribers()) {
       return;
     }
-    std::vector<std::string> sqls;
-    if (sync_off) {
-      sqls.emplace_back("PRAGMA synchronous = OFF;");
+    // Subscribers expect the primary key column's own type.
+    using Constructor = typename RowDecoder<T>::Constructor;
+    magic::ForRange<0, Constructor::column_size_>([&]<int I>() {
+      using ColumnType = typename Constructor::template ColumnType<I>;
+      if constexpr (std::is_constructible_v<ColumnType, const Key&>) {
+        if (I == helper.GetPrimaryKeyIndex()) {
+          NotifyKeyWritten(helper.GetTableName(), ColumnType(key));
+        }
+      }
+    });
+  }
+
+  /*
+   * Opens `column_name` of the row `rowid` for chunked reading, or writing when
+   * `writable` is set. The stream runs on a connection of its own, and a writable
+   * stream holds the database write lock until it is destroyed.
+   */
+  template <HasSqliteHelper T>
+  BlobStream OpenBlob(std::string_view column_name,
+                      sqlite3_int64 rowid,
+                      bool writable = false) {
+    std::shared_ptr<Connection> connection = pool_->OpenDedicated();
+    std::shared_ptr<sqlite3> db(connection, connection->get());
+    return BlobStream(std::move(db),
+                      std::string(GetDefaultSqliteHelper<T>().GetTableName()),
+                      std::string(column_name),
+                      rowid,
+                      writable);
+  }
+
+  /*
+   * Calls `callback` with the inserts, updates and deletes (by rowid) of T's table,
+   * batched per committed transaction, after the writing call released the
+   * database. Only writes made through this SqliteFile and its copies are reported
+   * (see ChangeFeed). The callback stays registered while the returned subscription
+   * lives; the hooks are only installed once the first subscription is made.
+   */
+  template <HasSqliteHelper T>
+  ChangeSubscription OnChange(ChangeFeed::Callback callback) {
+    std::call_once(*change_feed_attached_, [this] {
+      std::shared_ptr<ChangeFeed> feed = change_feed_;
+      pool_->AddWriterInitializer([feed](sqlite3* db) { feed->Attach(db); });
+      pool_->SetAfterWrite([feed] { feed->Flush(); });
+    });
+    int id = change_feed_->Subscribe(GetDefaultSqliteHelper<T>().GetTableName(),
+                                     std::move(callback));
+    return ChangeSubscription(change_feed_, id);
+  }
+
+  /*
+   * Calls `callback` with the primary key of every row written to T's table by
+   * Insert, InsertRows, InsertWithBlob, Upsert or Delete, right after the write,
+   * and with nullptr after DropTable. Writes made inside a Transaction are reported
+   * once it has ended, committed or not. The callback runs under the feed lock and
+   * must not subscribe or unsubscribe.
+   */
+  template <HasSqliteHelper T>
+  ChangeSubscription OnKeyWritten(ChangeFeed::KeyCallback callback) {
+    std::shared_ptr<ChangeFeed> feed = change_feed_;
+    pool_->SetAfterWrite([feed] { feed->Flush(); });
+    int id = change_feed_->SubscribeKeys(GetDefaultSqliteHelper<T>().GetTableName(),
+                                         std::move(callback));
+    return ChangeSubscription(change_feed_, id);
+  }
+
+ private:
+  template <std::ranges::contiguous_range Keys>
+  static std::string ToJsonArray(const Keys& keys) {
+    using Key = std::ranges::range_value_t<Keys>;
+    std::string json;
+    json.reserve(std::ranges::size(keys) * 8 + 2);
+    json += '[';
+    for (const Key& key : keys) {
+      if (json.size() > 1) {
+        json += ',';
+      }
+      if constexpr (std::floating_point<Key>) {
+        // JSON has no NaN or infinity. sqlite reads 9e999 as infinity, the way its
+        // own json functions write it; a NaN key matches no row, as sqlite stores
+        // NaN as NULL.
+        if (std::isnan(key)) {
+          json += "null";
+          continue;
+        }
+        if (std::isinf(key)) {
+          json += key < 0 ? "-9e999" : "9e999";
+          continue;
+        }
+      }
+      if constexpr (std::integral<Key> || std::floating_point<Key>) {
+        char buffer[32];
+        auto [end, ec] = std::to_chars(buffer, buffer + sizeof(buffer), key);
+        json.append(buffer, end);
+      } else {
+        utils::AppendJsonString(json, ToDataBaseString(key));
+      }
     }
-    sqls.emplace_back("BEGIN;");  // Open transaction
+    json += ']';
+    return json;
+  }
+
+  /*
+   * Inserts `rows` through the cached prepared INSERT inside one savepoint, and
+   * returns how many were inserted.
+   */
+  template <HasSqliteHelper T>
+  size_t InsertBatch(std::vector<T>& rows) {
     auto helper = rows.front().sql_constructor();
+    {
+      auto db           = pool_->AcquireWriter();
+      AtomicWrite write = StartAtomicWrite(db.get(), "sol_import");
+      sqlite3wrap::ExecuteSql(db.get(), write.begin);
+      try {
+        auto stmt = db->Prepare(helper.GetInsertStmtSQL());
+        for (auto& row : rows) {
+          helper.SetRef(&row);
+          BindRow(stmt.get(), helper);
+          sqlite3wrap::Step(stmt.get());
+          sqlite3_reset(stmt.get());
+        }
+      } catch (...) {
+        UndoAtomicWrite(db.get(), write);
+        throw;
+      }
+      sqlite3wrap::ExecuteSql(db.get(), write.end);
+    }
     for (auto& row : rows) {
       helper.SetRef(&row);
-      sqls.emplace_back(helper.GetInsertSQL());
+      NotifyKeyWritten(helper);
     }
-    sqls.emplace_back("COMMIT;");
+    return rows.size();
+  }
 
-    auto db = sqlite3wrap::OpenDatabase(path_.c_str());
-    sqlite3wrap::ExecuteSql(db.get(), utils::StrJoin("", sqls));
+  // Scans whole partitions, which SetQueryCheck must not report.
+  template <HasSqliteHelper>
+  friend class PartitionedTable;
+
+  // Query, with the SetQueryCheck check applied if `check` is true.
+  template <HasSqliteHelper T>
+  std::vector<T> QueryRows(const std::string& sql, bool check) {
+    std::vector<T> result;
+    RowDecoder<T> decoder;
+    auto db   = pool_->AcquireReader();
+    auto stmt = db->Prepare(sql);
+    while (sqlite3wrap::Step(stmt.get())) {
+      decoder.DecodeInto(stmt.get(), result.emplace_back());
+    }
+    if (check) {
+      CheckStatement(stmt.get());
+    }
+    return result;
+  }
+
+  // How a write that must apply fully or not at all starts, ends and is undone.
+  struct AtomicWrite {
+    std::string begin;
+    std::string end;
+    std::string undo;
+    std::optional<ChangeFeed::PendingMark> mark;
+  };
+
+  /*
+   * Opens a write named `name` on the writer connection `db` as a transaction of its
+   * own, or as a savepoint when one is already open. A savepoint is not used on its
+   * own: ROLLBACK TO fires no rollback hook and the RELEASE after it commits, which
+   * would deliver the undone changes to OnChange subscribers.
+   */
+  AtomicWrite StartAtomicWrite(sqlite3* db, std::string_view name) {
+    if (sqlite3_get_autocommit(db)) {
+      return {"BEGIN;", "COMMIT;", "ROLLBACK;", std::nullopt};
+    }
+    return {utils::StrCombine("SAVEPOINT ", name, ";"),
+            utils::StrCombine("RELEASE ", name, ";"),
+            utils::StrCombine("ROLLBACK TO ", name, "; RELEASE ", name, ";"),
+            change_feed_->MarkPending()};
+  }
+
+  // Undoes `write` after a failure, with the change events it queued.
+  void UndoAtomicWrite(sqlite3* db, const AtomicWrite& write) {
+    sqlite3_exec(db, write.undo.c_str(), nullptr, nullptr, nullptr);
+    if (write.mark) {
+      change_feed_->DropPendingSince(*write.mark);
+    }
+  }
+
+  // Rebuilds every FTS5 index kept in sync with a table (see SetFullText).
+  static void RebuildFullTextIndexes(sqlite3* db) {
+    std::vector<std::string> names;
+    {
+      auto stmt = sqlite3wrap::Prepare(
+          db,
+          "SELECT name FROM sqlite_master WHERE type = 'table' AND "
+          "sql LIKE 'CREATE VIRTUAL TABLE % USING fts5(%content=%';");
+      while (sqlite3wrap::Step(stmt.get())) {
+        names.emplace_back(sqlite3wrap::ColumnText(stmt.get(), 0));
+      }
+    }
+    if (names.empty()) {
+      return;
+    }
+    std::string sql = "SAVEPOINT sol_rebuild_fts;";
+    for (const std::string& name : names) {
+      utils::StrAppend(
+          sql, "INSERT INTO \"", name, "\"( \"", name, "\" ) VALUES( 'rebuild' );");
+    }
+    utils::StrAppend(sql, "RELEASE sol_rebuild_fts;");
+    try {
+      sqlite3wrap::ExecuteSql(db, sql);
+    } catch (...) {
+      sqlite3_exec(db,
+                   "ROLLBACK TO sol_rebuild_fts; RELEASE sol_rebuild_fts;",
+                   nullptr,
+                   nullptr,
+                   nullptr);
+      throw;
+    }
+  }
+
+  // Whether EnsureTables already recorded `fingerprint` in this database.
+  static bool HasSchemaFingerprint(Connection& connection, sqlite3_int64 fingerprint) {
+    {
+      auto stmt = connection.Prepare(
+          "SELECT 1 FROM sqlite_master WHERE type = 'table' AND "
+          "name = 'sol_schema_fingerprints';");
+      if (!sqlite3wrap::Step(stmt.get())) {
+        return false;
+      }
+    }
+    auto stmt = connection.Prepare(
+        "SELECT 1 FROM sol_schema_fingerprints WHERE fingerprint = ?;");
+    sqlite3wrap::BindValue(stmt.get(), 1, fingerprint);
+    return sqlite3wrap::Step(stmt.get());
+  }
+
+  /*
+   * Copies T's table from the attached database "sol_source" into "main" with one
+   * INSERT ... SELECT and returns the number of rows written.
+   */
+  template <HasSqliteHelper T>
+  static size_t CopyAttachedTable(sqlite3* db, ConflictPolicy policy) {
+    auto& helper           = GetDefaultSqliteHelper<T>();
+    std::string table_name = std::string(helper.GetTableName());
+    {
+      auto exists = sqlite3wrap::Prepare(
+          db,
+          "SELECT 1 FROM sol_source.sqlite_master WHERE type = 'table' AND name = ?;");
+      sqlite3wrap::BindValue(exists.get(), 1, table_name);
+      if (!sqlite3wrap::Step(exists.get())) {
+        return 0;
+      }
+    }
+    EnsureTableOn(db, helper);
+
+    std::string_view verb   = "INSERT";
+    std::string_view suffix = "";
+    switch (policy) {
+      case ConflictPolicy::kAbort:
+        break;
+      case ConflictPolicy::kIgnore:
+        verb = "INSERT OR IGNORE";
+        break;
+      case ConflictPolicy::kReplace:
+        verb = "INSERT OR REPLACE";
+        break;
+      case ConflictPolicy::kUpdate:
+        RequirePrimaryKey(helper);
+        // The WHERE keeps ON CONFLICT from being parsed as a join constraint.
+        suffix = " WHERE true";
+        break;
+    }
+    std::string columns = utils::StrJoin(", ", helper.GetColumnNames());
+    sqlite3wrap::ExecuteSql(
+        db,
+        utils::StrCombine(verb,
+                          " INTO main.\"",
+                          table_name,
+                          "\" ( ",
+                          columns,
+                          " ) SELECT ",
+                          columns,
+                          " FROM sol_source.\"",
+                          table_name,
+                          "\"",
+                          suffix,
+                          policy == ConflictPolicy::kUpdate
+                              ? std::string_view(helper.GetOnConflictUpdateSQL())
+                              : std::string_view(),
+                          ";"));
+    auto copied = static_cast<size_t>(sqlite3_changes(db));
+    // REPLACE deletes the rows it overwrites without running delete triggers.
+    if (policy == ConflictPolicy::kReplace && helper.HasFullText()) {
+      sqlite3wrap::ExecuteSql(db, helper.GetFullTextRebuildSQL());
+    }
+    return copied;
+  }
+
+  /*
+   * Runs the CREATE statements of `table` on `db`. A full-text index created by
+   * them for a table that already has rows is filled from the table.
+   */
+  template <typename RowTuple>
+  static void EnsureTableOn(sqlite3* db, const SqlConstructor<RowTuple>& table) {
+    bool new_index = false;
+    if (table.HasFullText()) {
+      auto exists = sqlite3wrap::Prepare(
+          db, "SELECT 1 FROM main.sqlite_master WHERE type = 'table' AND name = ?;");
+      sqlite3wrap::BindValue(exists.get(), 1, table.GetFullTextTableName());
+      new_index = !sqlite3wrap::Step(exists.get());
+    }
+    sqlite3wrap::ExecuteSql(db, table.GetEnsureTableSQL());
+    if (new_index) {
+      sqlite3wrap::ExecuteSql(db, table.GetFullTextRebuildSQL());
+    }
+  }
+
+  inline void AddFunction(const std::string& name,
+                          std::function<void(sqlite3* db)> create) {
+    if (pool_->InTransaction()) {
+      throw std::runtime_error(
+          utils::StrCombine("Cannot register SQL function ", name, " in a transaction"));
+    }
+    pool_->AddConnectionInitializer(std::move(create));
+  }
+
+  inline void CheckStatement(sqlite3_stmt* stmt) const {
+    sqlite3wrap::CheckStatement(stmt, query_check_->load(std::memory_order_relaxed));
+  }
+
+  /*
+   * Binds every column of the row `helper` points at, in column order. Text is not
+   * copied, so the row must outlive the step.
+   */
+  template <typename Constructor>
+  static void BindRow(sqlite3_stmt* stmt, const Constructor& helper) {
+    magic::ForRange<0, Constructor::column_size_>([&]<int I>() {
+      sqlite3wrap::BindField(stmt, I + 1, helper.template GetFieldByIndex<I>());
+    });
+  }
+
+  template <typename Constructor>
+  static void RequirePrimaryKey(const Constructor& helper) {
+    if (!helper.HasPrimaryKey()) {
+      throw std::runtime_error(utils::StrCombine(
+          "Table has no primary key: ", helper.GetTableName()));
+    }
+  }
+
+  template <typename Constructor>
+  void NotifyKeyWritten(const Constructor& helper) {
+    if (!helper.HasPrimaryKey() || !change_feed_->HasKeySubscribers()) {
+      return;
+    }
+    magic::ForRange<0, Constructor::column_size_>([&]<int I>() {
+      if (I == helper.GetPrimaryKeyIndex()) {
+        using ColumnType = typename Constructor::template ColumnType<I>;
+        NotifyKeyWritten(helper.GetTableName(),
+                         *static_cast<const ColumnType*>(helper.GetFieldPtrByIndex(I)));
+      }
+    });
+  }
+
+  /*
+   * Reports `key` to the key subscribers of `table_name`. Inside a transaction the
+   * report waits until it has ended: a cache invalidated right away could reload
+   * the old row from another thread before the COMMIT.
+   */
+  template <typename Key>
+  void NotifyKeyWritten(std::string_view table_name, const Key& key) {
+    if (!change_feed_->HasKeySubscribers()) {
+      return;
+    }
+    if (pool_->InTransaction()) {
+      change_feed_->DeferKeyWritten(table_name, std::make_shared<const Key>(key));
+    } else {
+      change_feed_->NotifyKeyWritten(table_name, &key);
+    }
+  }
+
+  // Reports every row of `table_name` as written, like NotifyKeyWritten.
+  void NotifyTableWritten(std::string_view table_name) {
+    if (!change_feed_->HasKeySubscribers()) {
+      return;
+    }
+    if (pool_->InTransaction()) {
+      change_feed_->DeferKeyWritten(table_name, nullptr);
+    } else {
+      change_feed_->NotifyKeyWritten(table_name, nullptr);
+    }
   }
 
- private:
   std::filesystem::path path_;
+  std::shared_ptr<ConnectionPool> pool_;
+  std::shared_ptr<ChangeFeed> change_feed_;
+  std::shared_ptr<std::once_flag> change_feed_attached_;
+  std::shared_ptr<std::atomic<QueryCheck>> query_check_;
 };
 
 }  // namespace sqliteol
@@ -1,10 +1,19 @@
 #include "sol/sqlite_file.h"
 
+#include <atomic>
+#include <chrono>
 #include <filesystem>
+#include <fstream>
+#include <latch>
+#include <limits>
+#include <optional>
+#include <sstream>
+#include <thread>
 
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "sol/sql_constructor_builder.h"
+#include "sol/sqlite_snapshot.h"
 
 using namespace sqliteol;
 using namespace testing;
@@ -81,6 +90,1042 @@ TEST(SqliteFileTest, InsertRowsAndRetrieveData) {
   }
 }
 
+TEST(SqliteFileTest, InsertQuotesTextValues) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  db_file.EnsureTable<MyCustomType>();
+
+  MyCustomType single = {1, "O'Brien", 1.70};
+  db_file.Insert(single);
+  std::vector<MyCustomType> rows = {{2, "'quoted'", 1.80}, {3, "''", 1.90}};
+  db_file.InsertRows(rows);
+
+  auto retrieved = db_file.GetTable<MyCustomType>();
+  ASSERT_EQ(retrieved.size(), 3);
+  EXPECT_EQ(retrieved[0].name, "O'Brien");
+  EXPECT_EQ(retrieved[1].name, "'quoted'");
+  EXPECT_EQ(retrieved[2].name, "''");
+}
+
+struct Document {
+  int id;
+  std::string title;
+  std::string body;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("Document")
+        .AddColumn("id", &id)
+        .AddColumn("title", &title)
+        .AddColumn("body", &body)
+        .Build();
+  }
+};
+
+TEST(SqliteFileTest, StreamBlobInChunks) {
+  TmpDir tmp_dir{"StreamBlobInChunks"};
+  SqliteFile db_file(tmp_dir.path() / "test.db");
+
+  db_file.EnsureTable<Document>();
+
+  std::string content(3 * 1024 * 1024 + 17, '\0');
+  for (size_t i = 0; i < content.size(); ++i) {
+    content[i] = static_cast<char>('a' + i % 26);
+  }
+
+  Document doc = {7, "big", ""};
+  auto rowid   = db_file.InsertWithBlob(doc, "body", content.size());
+  {
+    auto blob_in = db_file.OpenBlob<Document>("body", rowid, true);
+    std::istringstream in(content);
+    EXPECT_EQ(blob_in.CopyFrom(in, 4096), content.size());
+  }
+
+  auto blob_out = db_file.OpenBlob<Document>("body", rowid);
+  ASSERT_EQ(blob_out.Size(), content.size());
+  std::ostringstream out;
+  blob_out.CopyTo(out, 1000);
+  EXPECT_EQ(out.str(), content);
+
+  auto retrieved = db_file.GetTable<Document>();
+  ASSERT_EQ(retrieved.size(), 1);
+  EXPECT_EQ(retrieved[0].id, 7);
+  EXPECT_EQ(retrieved[0].title, "big");
+}
+
+TEST(SqliteFileTest, InMemoryBackupAndRestore) {
+  TmpDir tmp_dir{"InMemoryBackupAndRestore"};
+  SqliteFile memory_file = SqliteFile::InMemory();
+  EXPECT_TRUE(memory_file.IsInMemory());
+
+  memory_file.EnsureTable<MyCustomType>();
+  std::vector<MyCustomType> data = {{1, "Alice", 1.70}, {2, "Bob", 1.80}};
+  memory_file.InsertRows(data);
+  ASSERT_EQ(memory_file.GetTable<MyCustomType>().size(), data.size());
+
+  SqliteFile disk_file(tmp_dir.path() / "snapshot.db");
+  memory_file.BackupTo(disk_file, {.pages_per_step = 1});
+  auto on_disk = disk_file.GetTable<MyCustomType>();
+  ASSERT_EQ(on_disk.size(), data.size());
+  EXPECT_EQ(on_disk[1].name, "Bob");
+
+  SqliteFile loaded = SqliteFile::LoadIntoMemory(tmp_dir.path() / "snapshot.db");
+  auto in_memory    = loaded.GetTable<MyCustomType>();
+  ASSERT_EQ(in_memory.size(), data.size());
+  EXPECT_EQ(in_memory[0].name, "Alice");
+}
+
+TEST(SqliteFileTest, SharedInMemoryDatabase) {
+  SqliteFile writer = SqliteFile::InMemory("SharedInMemoryDatabase");
+  writer.EnsureTable<MyCustomType>();
+  MyCustomType data = {1, "Alice", 1.70};
+  writer.Insert(data);
+
+  SqliteFile reader(writer.path());
+  auto retrieved = reader.GetTable<MyCustomType>();
+  ASSERT_EQ(retrieved.size(), 1);
+  EXPECT_EQ(retrieved[0].name, "Alice");
+}
+
+TEST(SqliteFileTest, PeriodicSnapshot) {
+  TmpDir tmp_dir{"PeriodicSnapshot"};
+  SqliteFile memory_file = SqliteFile::InMemory();
+  memory_file.EnsureTable<MyCustomType>();
+  MyCustomType data = {1, "Alice", 1.70};
+  memory_file.Insert(data);
+
+  {
+    PeriodicSnapshot snapshot(
+        memory_file, tmp_dir.path() / "periodic.db", std::chrono::milliseconds(10));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    snapshot.SnapshotNow();
+  }
+
+  SqliteFile disk_file(tmp_dir.path() / "periodic.db");
+  EXPECT_EQ(disk_file.GetTable<MyCustomType>().size(), 1);
+}
+
+TEST(SqliteFileTest, CachedConnectionsAcrossThreads) {
+  TmpDir tmp_dir{"CachedConnectionsAcrossThreads"};
+  SqliteFile db_file(tmp_dir.path() / "test.db",
+                     {.mode = ConnectionMode::kCached, .wal = true});
+
+  db_file.EnsureTable<MyCustomType>();
+
+  constexpr int kWriters       = 2;
+  constexpr int kReaders       = 4;
+  constexpr int kRowsPerWriter = 50;
+  std::vector<std::thread> threads;
+  for (int w = 0; w < kWriters; ++w) {
+    threads.emplace_back([&, w] {
+      for (int i = 0; i < kRowsPerWriter; ++i) {
+        MyCustomType row = {w * kRowsPerWriter + i, "row", 1.0};
+        db_file.Insert(row);
+      }
+    });
+  }
+  for (int r = 0; r < kReaders; ++r) {
+    threads.emplace_back([&] {
+      for (int i = 0; i < 20; ++i) {
+        EXPECT_LE(db_file.GetTable<MyCustomType>().size(), kWriters * kRowsPerWriter);
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  EXPECT_EQ(db_file.GetTable<MyCustomType>().size(), kWriters * kRowsPerWriter);
+}
+
+TEST(SqliteFileTest, CachedReadersOnFreshFileAndThreadExit) {
+  TmpDir tmp_dir{"CachedReadersOnFreshFileAndThreadExit"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  EXPECT_THAT(db_file.GetTableNames(), IsEmpty());
+
+  // Every thread's reader is closed when the thread exits, and cannot write.
+  std::string path = (tmp_dir.path() / "test.db").string();
+  auto pool        = std::make_shared<ConnectionPool>(
+      path, ConnectionOptions{.mode = ConnectionMode::kCached});
+  for (int i = 0; i < 3; ++i) {
+    std::thread([&] {
+      auto reader = pool->AcquireReader();
+      EXPECT_EQ(pool->ReaderCount(), 1);
+      EXPECT_THROW(sqlite3wrap::ExecuteSql(reader.get(), "CREATE TABLE t( x );"),
+                   std::runtime_error);
+    }).join();
+  }
+  EXPECT_EQ(pool->ReaderCount(), 0);
+}
+
+TEST(SqliteFileTest, OnChangeBatchesEventsPerCommit) {
+  TmpDir tmp_dir{"OnChangeBatchesEventsPerCommit"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<MyCustomType>();
+
+  std::vector<std::vector<ChangeEvent>> batches;
+  auto subscription = db_file.OnChange<MyCustomType>(
+      [&](const std::vector<ChangeEvent>& events) { batches.push_back(events); });
+  auto other = db_file.OnChange<Document>(
+      [&](const std::vector<ChangeEvent>&) { ADD_FAILURE() << "unrelated table"; });
+
+  MyCustomType row = {1, "Alice", 1.70};
+  db_file.Insert(row);
+  std::vector<MyCustomType> rows = {{2, "Bob", 1.80}, {3, "Charlie", 1.90}};
+  db_file.InsertRows(rows);
+
+  ASSERT_EQ(batches.size(), 2);
+  ASSERT_EQ(batches[0].size(), 1);
+  EXPECT_EQ(batches[0][0].type, ChangeType::kInsert);
+  EXPECT_EQ(batches[0][0].rowid, 1);
+  ASSERT_EQ(batches[1].size(), 2);
+  EXPECT_EQ(batches[1][1].rowid, 3);
+
+  subscription.Reset();
+  db_file.Insert(row);
+  EXPECT_EQ(batches.size(), 2);
+}
+
+// Makes syncs of main database files fail while `fail` is set, so COMMITs fail after
+// sqlite has called the commit hook. Registered as the default VFS.
+struct FailingSyncVfs {
+  static inline std::atomic<bool> fail = false;
+  static inline sqlite3_vfs vfs;
+  static inline sqlite3_io_methods methods;
+  static inline const sqlite3_io_methods* real_methods = nullptr;
+
+  static void Register() {
+    sqlite3_vfs* real = sqlite3_vfs_find(nullptr);
+    vfs          = *real;
+    vfs.zName    = "failing_sync";
+    vfs.pAppData = real;
+    vfs.xOpen    = [](sqlite3_vfs* self, const char* name, sqlite3_file* file, int flags,
+                   int* out_flags) {
+      auto* real = static_cast<sqlite3_vfs*>(self->pAppData);
+      int rc     = real->xOpen(real, name, file, flags, out_flags);
+      if (rc == SQLITE_OK && file->pMethods && (flags & SQLITE_OPEN_MAIN_DB)) {
+        real_methods  = file->pMethods;
+        methods       = *file->pMethods;
+        methods.xSync = [](sqlite3_file* file, int flags) {
+          return fail ? SQLITE_IOERR_FSYNC : real_methods->xSync(file, flags);
+        };
+        file->pMethods = &methods;
+      }
+      return rc;
+    };
+    sqlite3_vfs_register(&vfs, 1);
+  }
+};
+
+TEST(SqliteFileTest, OnChangeSkipsFailedCommit) {
+  FailingSyncVfs::Register();
+  TmpDir tmp_dir{"OnChangeSkipsFailedCommit"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<MyCustomType>();
+
+  std::vector<std::vector<ChangeEvent>> batches;
+  auto subscription = db_file.OnChange<MyCustomType>(
+      [&](const std::vector<ChangeEvent>& events) { batches.push_back(events); });
+
+  MyCustomType row     = {1, "Alice", 1.70};
+  FailingSyncVfs::fail = true;
+  EXPECT_THROW(db_file.InTransaction([&] { db_file.Insert(row); }), std::runtime_error);
+  EXPECT_THROW(db_file.Insert(row), std::runtime_error);
+  FailingSyncVfs::fail = false;
+  EXPECT_TRUE(batches.empty());
+
+  db_file.Insert(row);
+  ASSERT_EQ(batches.size(), 1);
+  EXPECT_EQ(batches[0].size(), 1);
+  EXPECT_EQ(db_file.GetTable<MyCustomType>().size(), 1);
+}
+
+struct KeyedRow {
+  int id;
+  std::string name;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("KeyedRow")
+        .AddColumn("id", &id)
+        .AddColumn("name", &name)
+        .SetPrimaryKey("id")
+        .Build();
+  }
+};
+
+TEST(SqliteFileTest, OnChangeSkipsFailedInsertRows) {
+  TmpDir tmp_dir{"OnChangeSkipsFailedInsertRows"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<KeyedRow>();
+
+  std::vector<std::vector<ChangeEvent>> batches;
+  auto subscription = db_file.OnChange<KeyedRow>(
+      [&](const std::vector<ChangeEvent>& events) { batches.push_back(events); });
+
+  std::vector<KeyedRow> duplicates = {{1, "one"}, {1, "again"}};
+  EXPECT_THROW(db_file.InsertRows(duplicates), std::runtime_error);
+  EXPECT_TRUE(batches.empty());
+  EXPECT_TRUE(db_file.GetTable<KeyedRow>().empty());
+
+  // Inside a transaction only the failed batch is undone.
+  db_file.InTransaction([&] {
+    KeyedRow row = {5, "five"};
+    db_file.Insert(row);
+    EXPECT_THROW(db_file.InsertRows(duplicates), std::runtime_error);
+  });
+  ASSERT_EQ(batches.size(), 1);
+  ASSERT_EQ(batches[0].size(), 1);
+  EXPECT_EQ(batches[0][0].rowid, 5);
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 1);
+}
+
+TEST(SqliteFileTest, GetByKeysKeepsRequestedOrder) {
+  TmpDir tmp_dir{"GetByKeysKeepsRequestedOrder"};
+  SqliteFile db_file(tmp_dir.path() / "test.db");
+  db_file.EnsureTable<KeyedRow>();
+
+  std::vector<KeyedRow> rows;
+  for (int i = 0; i < 1000; ++i) {
+    rows.push_back({i, "row" + std::to_string(i)});
+  }
+  db_file.InsertRows(rows);
+
+  std::vector<int> keys = {500, 3, 5000, 3, 999};
+  auto found            = db_file.GetByKeys<KeyedRow>(keys);
+  ASSERT_EQ(found.size(), keys.size());
+  EXPECT_EQ(found[0]->name, "row500");
+  EXPECT_EQ(found[1]->name, "row3");
+  EXPECT_FALSE(found[2].has_value());
+  EXPECT_EQ(found[3]->id, 3);
+  EXPECT_EQ(found[4]->name, "row999");
+
+  EXPECT_TRUE(db_file.GetByKeys<KeyedRow>(std::vector<int>{}).empty());
+  EXPECT_EQ(db_file.Get<KeyedRow>(42)->name, "row42");
+}
+
+struct Reading {
+  double position;
+  std::string label;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("Reading")
+        .AddColumn("position", &position)
+        .AddColumn("label", &label)
+        .SetPrimaryKey("position")
+        .Build();
+  }
+};
+
+TEST(SqliteFileTest, GetByKeysNonFiniteKeys) {
+  SqliteFile db_file = SqliteFile::InMemory();
+  db_file.EnsureTable<Reading>();
+
+  constexpr double kInf = std::numeric_limits<double>::infinity();
+  // Upsert binds its values, so the infinite keys are stored as reals.
+  std::vector<Reading> rows = {{0.5, "half"}, {kInf, "inf"}, {-kInf, "-inf"}};
+  for (Reading& row : rows) {
+    db_file.Upsert(row);
+  }
+
+  std::vector<double> keys = {
+      -kInf, std::numeric_limits<double>::quiet_NaN(), 0.5, kInf};
+  auto found = db_file.GetByKeys<Reading>(keys);
+  ASSERT_EQ(found.size(), keys.size());
+  EXPECT_EQ(found[0]->label, "-inf");
+  EXPECT_FALSE(found[1].has_value());
+  EXPECT_EQ(found[2]->label, "half");
+  EXPECT_EQ(found[3]->label, "inf");
+}
+
+TEST(SqliteFileTest, InsertRowsRestoresSynchronous) {
+  TmpDir tmp_dir{"InsertRowsRestoresSynchronous"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<KeyedRow>();
+  // Inside a transaction reads run on the (shared) writer connection.
+  auto writer_synchronous = [&] {
+    return db_file.InTransaction([&] {
+      return db_file.Query<KeyedRow>("SELECT synchronous, '' FROM pragma_synchronous;")
+          .at(0)
+          .id;
+    });
+  };
+  int synchronous = writer_synchronous();
+  ASSERT_NE(synchronous, 0);
+
+  std::vector<KeyedRow> rows = {{1, "one"}, {2, "two"}};
+  db_file.InsertRows(rows, true);
+  EXPECT_EQ(writer_synchronous(), synchronous);
+  // Also when the batch fails.
+  EXPECT_THROW(db_file.InsertRows(rows, true), std::runtime_error);
+  EXPECT_EQ(writer_synchronous(), synchronous);
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 2);
+}
+
+TEST(SqliteFileTest, ImportCsvAndNdjson) {
+  TmpDir tmp_dir{"ImportCsvAndNdjson"};
+  SqliteFile db_file(tmp_dir.path() / "test.db");
+  db_file.EnsureTable<KeyedRow>();
+
+  std::ofstream csv(tmp_dir.path() / "rows.csv");
+  csv << "name,ignored,id\r\n";
+  for (int i = 0; i < 1000; ++i) {
+    csv << "\"row, " << i << "\",x," << i << "\r\n";
+  }
+  csv.close();
+  ImportOptions csv_options{.threads = 4, .batch_rows = 64};
+  EXPECT_EQ(db_file.Import<KeyedRow>(tmp_dir.path() / "rows.csv", csv_options), 1000);
+  EXPECT_EQ(db_file.Get<KeyedRow>(999)->name, "row, 999");
+
+  std::ofstream ndjson(tmp_dir.path() / "rows.ndjson");
+  ndjson << "{\"id\": 1000, \"name\": \"line\\nbreak\"}\n\n{\"id\": 1001}\n";
+  ndjson.close();
+  ImportOptions ndjson_options{.format = ImportFormat::kNdjson};
+  EXPECT_EQ(db_file.Import<KeyedRow>(tmp_dir.path() / "rows.ndjson", ndjson_options), 2);
+  EXPECT_EQ(db_file.Get<KeyedRow>(1000)->name, "line\nbreak");
+  EXPECT_EQ(db_file.Get<KeyedRow>(1001)->name, "");
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 1002);
+
+  // Duplicate keys fail the import.
+  EXPECT_THROW(db_file.Import<KeyedRow>(tmp_dir.path() / "rows.ndjson", ndjson_options),
+               std::runtime_error);
+
+  // Inside a transaction a failed import keeps none of its batches.
+  std::ofstream partial(tmp_dir.path() / "partial.ndjson");
+  partial << "{\"id\": 2000}\n{\"id\": 1}\n";
+  partial.close();
+  ImportOptions partial_options{
+      .format = ImportFormat::kNdjson, .threads = 1, .batch_rows = 1};
+  auto import_partial = [&] {
+    db_file.Import<KeyedRow>(tmp_dir.path() / "partial.ndjson", partial_options);
+  };
+  EXPECT_THROW(db_file.InTransaction(import_partial), std::runtime_error);
+  EXPECT_FALSE(db_file.Get<KeyedRow>(2000).has_value());
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 1002);
+}
+
+TEST(SqliteFileTest, ExportCsvAndBinary) {
+  TmpDir tmp_dir{"ExportCsvAndBinary"};
+  SqliteFile db_file(tmp_dir.path() / "test.db");
+  db_file.EnsureTable<MyCustomType>();
+  std::vector<MyCustomType> rows = {{1, "Alice", 1.7}, {-2, "Bob, \"Jr\"", 1.85}};
+  db_file.InsertRows(rows);
+
+  EXPECT_EQ(db_file.Export<MyCustomType>(tmp_dir.path() / "rows.csv"), 2);
+  EXPECT_EQ(utils::MappedFile(tmp_dir.path() / "rows.csv").data(),
+            "id,name,height\n1,Alice,1.7\n-2,\"Bob, \"\"Jr\"\"\",1.85\n");
+
+  SqliteFile copy(tmp_dir.path() / "copy.db");
+  copy.EnsureTable<MyCustomType>();
+  EXPECT_EQ(copy.Import<MyCustomType>(tmp_dir.path() / "rows.csv"), 2);
+  auto copied = copy.GetTable<MyCustomType>();
+  ASSERT_EQ(copied.size(), 2);
+  EXPECT_EQ(copied[1].name, "Bob, \"Jr\"");
+  EXPECT_EQ(copied[1].height, 1.85);
+
+  ExportOptions binary_options{.format = ExportFormat::kBinary, .buffer_size = 16};
+  EXPECT_EQ(db_file.Export<MyCustomType>(tmp_dir.path() / "rows.bin", binary_options),
+            2);
+  utils::MappedFile binary(tmp_dir.path() / "rows.bin");
+  std::string_view input = binary.data();
+  EXPECT_THAT(export_format::ReadBinaryHeader(input),
+              ElementsAre("id", "name", "height"));
+  EXPECT_EQ(export_format::ReadBinaryValue(input).integer, 1);
+  EXPECT_EQ(export_format::ReadBinaryValue(input).bytes, "Alice");
+  EXPECT_EQ(export_format::ReadBinaryValue(input).real, 1.7);
+  EXPECT_EQ(export_format::ReadBinaryValue(input).integer, -2);
+  EXPECT_EQ(export_format::ReadBinaryValue(input).bytes, "Bob, \"Jr\"");
+  EXPECT_EQ(export_format::ReadBinaryValue(input).real, 1.85);
+  EXPECT_TRUE(input.empty());
+
+  // A failed export keeps the previous file and leaves no partial one behind.
+  EXPECT_THROW(db_file.Export<Document>(tmp_dir.path() / "rows.csv"),
+               std::runtime_error);
+  EXPECT_EQ(utils::MappedFile(tmp_dir.path() / "rows.csv").data(),
+            "id,name,height\n1,Alice,1.7\n-2,\"Bob, \"\"Jr\"\"\",1.85\n");
+  EXPECT_FALSE(std::filesystem::exists(tmp_dir.path() / "rows.csv.partial"));
+}
+
+TEST(SqliteFileTest, MergeFromWithConflictPolicies) {
+  TmpDir tmp_dir{"MergeFromWithConflictPolicies"};
+  SqliteFile source(tmp_dir.path() / "source.db");
+  SqliteFile target(tmp_dir.path() / "target.db", {.mode = ConnectionMode::kCached});
+  source.EnsureTable<KeyedRow>();
+  target.EnsureTable<KeyedRow>();
+  std::vector<KeyedRow> source_rows = {{1, "new1"}, {2, "new2"}};
+  std::vector<KeyedRow> target_rows = {{2, "old2"}, {3, "old3"}};
+  source.InsertRows(source_rows);
+  target.InsertRows(target_rows);
+
+  EXPECT_THROW(target.MergeFrom<KeyedRow>(source.path()), std::runtime_error);
+  EXPECT_EQ(target.GetTable<KeyedRow>().size(), 2);
+
+  EXPECT_EQ(target.MergeFrom<KeyedRow>(source.path(), ConflictPolicy::kIgnore), 1);
+  EXPECT_EQ(target.Get<KeyedRow>(2)->name, "old2");
+  EXPECT_EQ(target.MergeFrom<KeyedRow>(source.path(), ConflictPolicy::kUpdate), 2);
+  EXPECT_EQ(target.Get<KeyedRow>(2)->name, "new2");
+  EXPECT_EQ(target.GetTable<KeyedRow>().size(), 3);
+
+  // Tables are created in the destination; tables missing from the source are skipped.
+  SqliteFile empty(tmp_dir.path() / "empty.db");
+  EXPECT_EQ(SqliteFile::CopyTable<KeyedRow>(source, empty), 2);
+  EXPECT_EQ(empty.MergeFrom<MyCustomType>(source.path()), 0);
+
+  SqliteFile memory = SqliteFile::InMemory();
+  EXPECT_THROW(SqliteFile::CopyTable<KeyedRow>(memory, empty), std::runtime_error);
+  EXPECT_THROW(target.InTransaction([&] { target.MergeFrom<KeyedRow>(source.path()); }),
+               std::runtime_error);
+}
+
+TEST(SqliteFileTest, EnsureTablesSkipsKnownSchema) {
+  TmpDir tmp_dir{"EnsureTablesSkipsKnownSchema"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTables<MyCustomType, KeyedRow>();
+  KeyedRow row = {1, "one"};
+  db_file.Insert(row);
+  EXPECT_TRUE(db_file.GetTable<MyCustomType>().empty());
+
+  // Once the fingerprint is recorded, a table dropped behind the library's back is
+  // not recreated: the call did no DDL at all.
+  {
+    auto db = sqlite3wrap::OpenDatabase((tmp_dir.path() / "test.db").c_str());
+    sqlite3wrap::ExecuteSql(db.get(), "DROP TABLE \"MyCustomType\";");
+  }
+  db_file.EnsureTables<MyCustomType, KeyedRow>();
+  EXPECT_THROW(db_file.GetTable<MyCustomType>(), std::runtime_error);
+
+  // A different set of types has a different fingerprint.
+  db_file.EnsureTables<MyCustomType>();
+  EXPECT_TRUE(db_file.GetTable<MyCustomType>().empty());
+
+  // DropTable forgets the fingerprints.
+  db_file.DropTable<MyCustomType>();
+  db_file.EnsureTables<MyCustomType, KeyedRow>();
+  EXPECT_TRUE(db_file.GetTable<MyCustomType>().empty());
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 1);
+}
+
+struct Sample {
+  int64_t time;
+  double value;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("Sample")
+        .AddColumn("time", &time)
+        .AddColumn("value", &value)
+        .SetPrimaryKey("time")
+        .SetStrict()
+        .SetWithoutRowid()
+        .Build();
+  }
+};
+
+TEST(SqliteFileTest, StrictWithoutRowidTable) {
+  TmpDir tmp_dir{"StrictWithoutRowidTable"};
+  SqliteFile db_file(tmp_dir.path() / "test.db");
+  db_file.EnsureTable<Sample>();
+
+  std::vector<Sample> rows = {{30, 3.5}, {10, 1.5}, {20, 2}};
+  db_file.InsertRows(rows);
+  Sample update = {20, 2.5};
+  db_file.Upsert(update);
+
+  auto table = db_file.GetTable<Sample>();  // Clustered on the key
+  ASSERT_EQ(table.size(), 3);
+  EXPECT_EQ(table[0].time, 10);
+  EXPECT_EQ(table[1].value, 2.5);
+  EXPECT_EQ(db_file.Get<Sample>(30)->value, 3.5);
+
+  // Reals are read natively, without the 15 digits of their text form.
+  Sample precise = {40, 0.1 + 0.2};
+  db_file.Upsert(precise);
+  EXPECT_EQ(db_file.Get<Sample>(40)->value, 0.1 + 0.2);
+
+  // STRICT rejects values of the wrong storage class instead of storing them as text.
+  auto db = sqlite3wrap::OpenDatabase((tmp_dir.path() / "test.db").c_str());
+  EXPECT_THROW(sqlite3wrap::ExecuteSql(
+                   db.get(), "INSERT INTO \"Sample\" VALUES( 50, 'not a number' );"),
+               std::runtime_error);
+}
+
+TEST(SqliteFileTest, ExplainAndQueryCheck) {
+  TmpDir tmp_dir{"ExplainAndQueryCheck"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<KeyedRow>();
+  db_file.EnsureTable<MyCustomType>();
+
+  QueryPlan plan = db_file.Explain<KeyedRow>(TypedQuery::kGet);
+  ASSERT_FALSE(plan.steps.empty());
+  EXPECT_FALSE(plan.HasFullScan()) << plan.ToString();
+  EXPECT_TRUE(db_file.Explain<KeyedRow>(TypedQuery::kGetTable).HasFullScan());
+  EXPECT_THROW(db_file.Explain<MyCustomType>(TypedQuery::kGet), std::runtime_error);
+
+  plan = db_file.Explain("SELECT name FROM \"MyCustomType\" ORDER BY name;");
+  EXPECT_TRUE(plan.HasFullScan());
+  EXPECT_TRUE(plan.HasTempBTree());
+  EXPECT_THAT(plan.ToString(), HasSubstr("SCAN MyCustomType"));
+
+  db_file.SetQueryCheck(QueryCheck::kThrow);
+  std::vector<KeyedRow> rows = {{1, "one"}, {2, "two"}};
+  db_file.InsertRows(rows);
+  EXPECT_EQ(db_file.Get<KeyedRow>(2)->name, "two");
+  EXPECT_EQ(db_file.GetByKeys<KeyedRow>(std::vector<int>{2, 1}).size(), 2);
+  db_file.Upsert(rows[0]);
+  EXPECT_EQ(db_file.Query<KeyedRow>("SELECT * FROM KeyedRow WHERE id = 2;").size(), 1);
+  EXPECT_THROW(db_file.Query<KeyedRow>("SELECT * FROM KeyedRow WHERE name = 'two';"),
+               std::runtime_error);
+  db_file.Delete<KeyedRow>(1);
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 1);
+
+  // The same type on a table created without its primary key has to be scanned.
+  SqliteFile legacy(tmp_dir.path() / "legacy.db");
+  {
+    auto db = sqlite3wrap::OpenDatabase((tmp_dir.path() / "legacy.db").c_str());
+    sqlite3wrap::ExecuteSql(db.get(),
+                            "CREATE TABLE \"KeyedRow\"( id INTEGER, name TEXT );"
+                            "INSERT INTO \"KeyedRow\" VALUES( 1, 'one' ), ( 2, 'two' );");
+  }
+  EXPECT_EQ(legacy.Get<KeyedRow>(2)->name, "two");
+  legacy.SetQueryCheck(QueryCheck::kThrow);
+  EXPECT_THROW(legacy.Get<KeyedRow>(2), std::runtime_error);
+}
+
+TEST(SqliteFileTest, StorageStatsAndIncrementalVacuum) {
+  TmpDir tmp_dir{"StorageStatsAndIncrementalVacuum"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnableIncrementalVacuum();
+  db_file.EnsureTable<KeyedRow>();
+  db_file.EnsureTable<MyCustomType>();
+
+  std::vector<KeyedRow> rows;
+  for (int i = 0; i < 2000; ++i) {
+    rows.push_back({i, std::string(200, 'x')});
+  }
+  db_file.InsertRows(rows);
+  db_file.Analyze();
+  db_file.Optimize();
+
+  StorageStats stats = db_file.GetStorageStats();
+  ASSERT_FALSE(stats.objects.empty());
+  EXPECT_EQ(stats.objects.front().name, "KeyedRow");
+  EXPECT_GT(stats.objects.front().payload_bytes, 2000 * 200);
+  EXPECT_EQ(stats.objects.front().bytes, stats.objects.front().pages * stats.page_size);
+  EXPECT_EQ(stats.freelist_count, 0);
+
+  db_file.DropTable<KeyedRow>();
+  StorageStats dropped = db_file.GetStorageStats();
+  EXPECT_GT(dropped.freelist_count, 0);
+  EXPECT_EQ(dropped.page_count, stats.page_count);
+
+  EXPECT_EQ(db_file.IncrementalVacuum(std::chrono::seconds(10), 8),
+            dropped.freelist_count);
+  StorageStats vacuumed = db_file.GetStorageStats();
+  EXPECT_EQ(vacuumed.freelist_count, 0);
+  EXPECT_LT(vacuumed.page_count, dropped.page_count);
+  EXPECT_EQ(db_file.IncrementalVacuum(std::chrono::seconds(10)), 0);
+}
+
+struct Article {
+  int64_t id;
+  std::string title;
+  std::string body;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("Article")
+        .AddColumn("id", &id)
+        .AddColumn("title", &title)
+        .AddColumn("body", &body)
+        .SetPrimaryKey("id")
+        .SetFullText("title")
+        .SetFullText("body")
+        .Build();
+  }
+};
+
+std::vector<int64_t> ArticleIds(const std::vector<Article>& articles) {
+  std::vector<int64_t> ids;
+  for (const Article& article : articles) {
+    ids.push_back(article.id);
+  }
+  return ids;
+}
+
+TEST(SqliteFileTest, FullTextSearch) {
+  TmpDir tmp_dir{"FullTextSearch"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<Article>();
+
+  std::vector<Article> articles = {
+      {1, "Cooking", "Slow roasted vegetables"},
+      {2, "Databases", "SQLite indexes and the query planner"},
+      {3, "SQLite tuning", "Indexes, WAL and SQLite pragmas"},
+  };
+  db_file.InsertRows(articles);
+  db_file.SetQueryCheck(QueryCheck::kThrow);
+
+  // More occurrences rank higher.
+  EXPECT_THAT(ArticleIds(db_file.Search<Article>("sqlite")), ElementsAre(3, 2));
+  EXPECT_THAT(ArticleIds(db_file.Search<Article>("sqlite", 1)), ElementsAre(3));
+  EXPECT_THAT(ArticleIds(db_file.Search<Article>("title:cooking")), ElementsAre(1));
+  EXPECT_THAT(db_file.Search<Article>("postgres"), IsEmpty());
+
+  // Triggers keep the index in sync with updates and deletes.
+  Article rewritten = {1, "Cooking", "Recipes stored in SQLite"};
+  db_file.Upsert(rewritten);
+  db_file.Delete<Article>(int64_t{3});
+  EXPECT_THAT(ArticleIds(db_file.Search<Article>("sqlite")), UnorderedElementsAre(1, 2));
+  EXPECT_THAT(db_file.Search<Article>("vegetables"), IsEmpty());
+
+  // An index created for a table that already has rows is filled from them.
+  {
+    auto db = sqlite3wrap::OpenDatabase((tmp_dir.path() / "test.db").c_str());
+    sqlite3wrap::ExecuteSql(db.get(), "DROP TABLE \"Article_fts\";");
+  }
+  db_file.EnsureTable<Article>();
+  EXPECT_THAT(ArticleIds(db_file.Search<Article>("planner")), ElementsAre(2));
+
+  EXPECT_THROW(db_file.Search<MyCustomType>("x"), std::runtime_error);
+  db_file.DropTable<Article>();
+  EXPECT_THAT(db_file.GetTableNames(), Not(Contains("Article_fts")));
+}
+
+struct Note {
+  std::string title;
+  std::string body;
+
+  auto sql_constructor() {
+    return SqlConstructorBuilder<>()
+        .SetTableName("Note")
+        .AddColumn("title", &title)
+        .AddColumn("body", &body)
+        .SetFullText("body")
+        .Build();
+  }
+};
+
+TEST(SqliteFileTest, FullTextRebuiltAfterVacuum) {
+  TmpDir tmp_dir{"FullTextRebuiltAfterVacuum"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<Note>();
+  std::vector<Note> notes = {{"a", "first note"}, {"b", "second note"}};
+  db_file.InsertRows(notes);
+
+  // Empty the index, as if the VACUUM had moved every row under it.
+  {
+    auto db = sqlite3wrap::OpenDatabase((tmp_dir.path() / "test.db").c_str());
+    sqlite3wrap::ExecuteSql(
+        db.get(), "INSERT INTO \"Note_fts\"( \"Note_fts\" ) VALUES( 'delete-all' );");
+  }
+  EXPECT_THAT(db_file.Search<Note>("second"), IsEmpty());
+
+  db_file.EnableIncrementalVacuum();
+  auto found = db_file.Search<Note>("second");
+  ASSERT_EQ(found.size(), 1);
+  EXPECT_EQ(found[0].title, "b");
+}
+
+TEST(SqliteFileTest, RegisteredSqlFunctions) {
+  TmpDir tmp_dir{"RegisteredSqlFunctions"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<KeyedRow>();
+  std::vector<KeyedRow> rows;
+  for (int i = 0; i < 10; ++i) {
+    rows.push_back({i, "row" + std::to_string(i)});
+  }
+  db_file.InsertRows(rows);
+  // Opens this thread's reader before the functions are registered.
+  EXPECT_EQ(db_file.Get<KeyedRow>(1)->name, "row1");
+
+  db_file.RegisterFunction("bucket",
+                           [](int64_t value, int64_t width) { return value / width; });
+  db_file.RegisterFunction(
+      "shout", [](std::string_view text) { return utils::StrCombine(text, "!"); });
+  db_file.RegisterFunction("twice",
+                           [](std::optional<int64_t> value) -> std::optional<int64_t> {
+                             if (!value) {
+                               return std::nullopt;
+                             }
+                             return *value * 2;
+                           });
+  db_file.RegisterFunction("fail", [](int64_t) -> int64_t {
+    throw std::invalid_argument("no such value");
+  });
+  db_file.RegisterAggregate(
+      "joined",
+      std::string(),
+      [](std::string& joined, std::string_view name) {
+        utils::StrAppend(joined, joined.empty() ? "" : "|", name);
+      },
+      [](const std::string& joined) { return joined; });
+  db_file.RegisterFunction("fail_oddly", [](int64_t) -> int64_t { throw 42; });
+  // A finalize taking its state by reference must not alter the initial state.
+  db_file.RegisterAggregate(
+      "counted",
+      int64_t{0},
+      [](int64_t& count, int64_t) { ++count; },
+      [](int64_t& count) { return ++count; });
+
+  auto found = db_file.Query<KeyedRow>(
+      "SELECT * FROM KeyedRow WHERE bucket(id, 5) = 1 AND shout(name) = 'row7!';");
+  ASSERT_EQ(found.size(), 1);
+  EXPECT_EQ(found[0].id, 7);
+
+  auto groups = db_file.Query<KeyedRow>(
+      "SELECT bucket(id, 5) AS b, joined(name) FROM KeyedRow GROUP BY b ORDER BY b;");
+  ASSERT_EQ(groups.size(), 2);
+  EXPECT_EQ(groups[0].name, "row0|row1|row2|row3|row4");
+  EXPECT_EQ(groups[1].id, 1);
+  EXPECT_EQ(groups[1].name, "row5|row6|row7|row8|row9");
+  auto empty = db_file.Query<KeyedRow>(
+      "SELECT COUNT(*), joined(name) FROM KeyedRow WHERE id < 0;");
+  ASSERT_EQ(empty.size(), 1);
+  EXPECT_EQ(empty[0].name, "");
+  for (int i = 0; i < 2; ++i) {
+    auto counted =
+        db_file.Query<KeyedRow>("SELECT counted(id), '' FROM KeyedRow WHERE id < 0;");
+    ASSERT_EQ(counted.size(), 1);
+    EXPECT_EQ(counted[0].id, 1);
+  }
+
+  auto nulls = db_file.Query<KeyedRow>(
+      "SELECT twice(21), CAST(twice(NULL) IS NULL AS TEXT);");
+  ASSERT_EQ(nulls.size(), 1);
+  EXPECT_EQ(nulls[0].id, 42);
+  EXPECT_EQ(nulls[0].name, "1");
+
+  try {
+    db_file.Query<KeyedRow>("SELECT fail(id), name FROM KeyedRow;");
+    ADD_FAILURE() << "Expected the function's exception to fail the query";
+  } catch (const std::runtime_error& e) {
+    EXPECT_THAT(e.what(), HasSubstr("no such value"));
+  }
+  EXPECT_THROW(db_file.Query<KeyedRow>("SELECT fail_oddly(id), name FROM KeyedRow;"),
+               std::runtime_error);
+
+  // Readers opened after the registration have the functions too.
+  size_t from_thread = 0;
+  std::thread([&] {
+    from_thread =
+        db_file.Query<KeyedRow>("SELECT * FROM KeyedRow WHERE bucket(id, 3) = 0;").size();
+  }).join();
+  EXPECT_EQ(from_thread, 3);
+
+  db_file.InTransaction([&] {
+    EXPECT_THROW(db_file.RegisterFunction("late", [](int64_t value) { return value; }),
+                 std::runtime_error);
+  });
+}
+
+TEST(SqliteFileTest, DeadlinesAndCancellation) {
+  TmpDir tmp_dir{"DeadlinesAndCancellation"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<KeyedRow>();
+  std::vector<KeyedRow> rows = {{1, "one"}, {2, "two"}};
+  db_file.InsertRows(rows);
+  // Never ends on its own.
+  const std::string endless =
+      "WITH RECURSIVE c(x) AS (SELECT 1 UNION ALL SELECT x + 1 FROM c) "
+      "SELECT MAX(x), 'x' FROM c;";
+
+  auto reason_of = [](auto&& call) -> std::optional<InterruptReason> {
+    try {
+      call();
+    } catch (const InterruptedError& e) {
+      return e.reason();
+    }
+    return std::nullopt;
+  };
+
+  {
+    ScopedDeadline deadline(std::chrono::milliseconds(50));
+    auto begin = std::chrono::steady_clock::now();
+    EXPECT_EQ(reason_of([&] { db_file.Query<KeyedRow>(endless); }),
+              InterruptReason::kDeadlineExceeded);
+    EXPECT_LT(std::chrono::steady_clock::now() - begin, std::chrono::seconds(5));
+    // Calls made after the deadline fail before running.
+    EXPECT_EQ(reason_of([&] { db_file.Get<KeyedRow>(1); }),
+              InterruptReason::kDeadlineExceeded);
+    EXPECT_EQ(reason_of([&] { db_file.Upsert(rows[0]); }),
+              InterruptReason::kDeadlineExceeded);
+  }
+
+  CancellationToken token;
+  std::thread canceller([token] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    token.Cancel();
+  });
+  {
+    ScopedDeadline cancellable(token);
+    // A nested scope keeps the outer token.
+    ScopedDeadline nested(std::chrono::minutes(1));
+    EXPECT_EQ(reason_of([&] { db_file.Query<KeyedRow>(endless); }),
+              InterruptReason::kCancelled);
+  }
+  canceller.join();
+
+  // Calls outside of any scope are unaffected.
+  EXPECT_EQ(db_file.Get<KeyedRow>(2)->name, "two");
+  ScopedDeadline generous(std::chrono::minutes(1));
+  EXPECT_EQ(db_file.GetTable<KeyedRow>().size(), 2);
+}
+
+TEST(SqliteFileTest, BusyPolicyRetriesLockedDatabase) {
+  TmpDir tmp_dir{"BusyPolicyRetriesLockedDatabase"};
+  SqliteFile locker(tmp_dir.path() / "test.db");
+  locker.EnsureTable<KeyedRow>();
+  SqliteFile no_retry(tmp_dir.path() / "test.db");
+  SqliteFile retrying(tmp_dir.path() / "test.db",
+                      {.busy = {.timeout = std::chrono::seconds(10)}});
+  KeyedRow row = {1, "one"};
+
+  // Another connection holds the write lock until the failing writes are done.
+  std::latch locked(1);
+  std::latch release(1);
+  std::thread holder([&] {
+    locker.InTransaction(
+        [&] {
+          locked.count_down();
+          release.wait();
+        },
+        TransactionMode::kExclusive);
+  });
+  locked.wait();
+  try {
+    no_retry.Upsert(row);
+    ADD_FAILURE() << "Expected SQLITE_BUSY";
+  } catch (const SqliteError& e) {
+    EXPECT_TRUE(e.IsBusy()) << e.what();
+  }
+  EXPECT_EQ(no_retry.GetBusyRetries(), 0);
+  {
+    ScopedDeadline deadline(std::chrono::milliseconds(10));
+    EXPECT_THROW(retrying.Upsert(row), InterruptedError);
+  }
+  EXPECT_GT(retrying.GetBusyRetries(), 0);
+  release.count_down();
+  retrying.Upsert(row);
+  holder.join();
+  EXPECT_EQ(retrying.Get<KeyedRow>(1)->name, "one");
+}
+
+TEST(SqliteFileTest, IoStatsPerFile) {
+  TmpDir tmp_dir{"IoStatsPerFile"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.io_stats = true});
+  db_file.EnsureTable<KeyedRow>();
+  std::vector<KeyedRow> rows;
+  for (int i = 0; i < 100; ++i) {
+    rows.push_back({i, "row" + std::to_string(i)});
+  }
+  db_file.InsertRows(rows);
+  EXPECT_EQ(db_file.Get<KeyedRow>(7)->name, "row7");
+
+  auto stats = db_file.GetIoStats();
+  ASSERT_EQ(stats.size(), 2);
+  const FileIoStats& database = stats[0];
+  const FileIoStats& journal  = stats[1];
+  EXPECT_THAT(database.path, EndsWith("test.db"));
+  EXPECT_GT(database.reads, 0);
+  EXPECT_GT(database.writes, 0);
+  EXPECT_GE(database.write_bytes, database.writes);
+  EXPECT_GT(database.syncs, 0);
+  EXPECT_LE(database.max_sync_time, database.sync_time);
+  EXPECT_THAT(journal.path, EndsWith("test.db-journal"));
+  EXPECT_GT(journal.writes, 0);
+
+  std::vector<std::string> logged;
+  auto ignore = [](const std::string&) {};
+  auto record = [&](const std::string& message) { logged.push_back(message); };
+  Logger::LogFunction previous = Logger::getInstance().GetLogFunctions();
+  Logger::getInstance().SetLogFunctions({ignore, ignore, record, ignore, ignore});
+  IoStatsVfs::SetSlowSyncThreshold(std::chrono::nanoseconds(1));
+  KeyedRow renamed = {0, "renamed"};
+  db_file.Upsert(renamed);
+  IoStatsVfs::SetSlowSyncThreshold(std::chrono::nanoseconds(0));
+  Logger::getInstance().SetLogFunctions(previous);
+  EXPECT_THAT(logged, Contains(HasSubstr("Slow sync of")));
+  EXPECT_GT(db_file.GetIoStats()[0].syncs, database.syncs);
+
+  SqliteFile archive(tmp_dir.path() / "test.db-archive", {.io_stats = true});
+  archive.EnsureTable<KeyedRow>();
+  EXPECT_EQ(db_file.GetIoStats().size(), 2);
+
+  SqliteFile uncounted(tmp_dir.path() / "uncounted.db");
+  uncounted.EnsureTable<KeyedRow>();
+  EXPECT_THAT(uncounted.GetIoStats(), IsEmpty());
+  EXPECT_THAT(SqliteFile::InMemory("", {.io_stats = true}).GetIoStats(), IsEmpty());
+}
+
+TEST(SqliteFileTest, TransactionCommitsAndRollsBack) {
+  TmpDir tmp_dir{"TransactionCommitsAndRollsBack"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<MyCustomType>();
+
+  {
+    Transaction transaction = db_file.BeginTransaction(TransactionMode::kImmediate);
+    MyCustomType row = {1, "Alice", 1.70};
+    db_file.Insert(row);
+    std::vector<MyCustomType> rows = {{2, "Bob", 1.80}};
+    db_file.InsertRows(rows);
+    EXPECT_EQ(db_file.GetTable<MyCustomType>().size(), 2);
+    {
+      Savepoint savepoint = transaction.MakeSavepoint();
+      db_file.Insert(row);
+      savepoint.Rollback();
+    }
+    transaction.Commit();
+  }
+  EXPECT_EQ(db_file.GetTable<MyCustomType>().size(), 2);
+
+  auto failing_work = [&] {
+    MyCustomType row = {3, "Charlie", 1.90};
+    db_file.Insert(row);
+    throw std::runtime_error("abort");
+  };
+  EXPECT_THROW(db_file.InTransaction(failing_work), std::runtime_error);
+  EXPECT_EQ(db_file.GetTable<MyCustomType>().size(), 2);
+
+  size_t size = db_file.InTransaction([&] {
+    EXPECT_THROW(db_file.BeginTransaction(), std::runtime_error);
+    return db_file.GetTable<MyCustomType>().size();
+  });
+  EXPECT_EQ(size, 2);
+}
+
+TEST(SqliteFileTest, TransactionReleasesWriterWhenEnded) {
+  TmpDir tmp_dir{"TransactionReleasesWriterWhenEnded"};
+  SqliteFile db_file(tmp_dir.path() / "test.db", {.mode = ConnectionMode::kCached});
+  db_file.EnsureTable<KeyedRow>();
+  int notified      = 0;
+  auto subscription = db_file.OnKeyWritten<KeyedRow>([&](const void*) {
+    ++notified;
+  });
+
+  Transaction committed = db_file.BeginTransaction(TransactionMode::kImmediate);
+  KeyedRow row          = {1, "Alice"};
+  db_file.Insert(row);
+  EXPECT_EQ(notified, 0);
+  committed.Commit();
+  EXPECT_EQ(notified, 1);
+  row = {2, "Bob"};
+  db_file.Insert(row);
+  EXPECT_EQ(notified, 2);
+
+  Transaction rolled_back = db_file.BeginTransaction(TransactionMode::kImmediate);
+  row                     = {3, "Charlie"};
+  db_file.Insert(row);
+  rolled_back.Rollback();
+  EXPECT_EQ(notified, 3);
+  row = {4, "Dana"};
+  db_file.Insert(row);
+  EXPECT_EQ(notified, 4);
+
+  std::vector<KeyedRow> rows = db_file.GetTable<KeyedRow>();
+  ASSERT_EQ(rows.size(), 3);
+  EXPECT_EQ(rows[2].name, "Dana");
+}
+
 }  // namespace
 
 int main(int argc, char** argv) {
@@ -0,0 +1,260 @@
+#pragma once
+
+#include <concepts>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#include "sol/serialize_template.h"
+#include "sol/sqlite3wrap.h"
+#include "sol/utils/str_utils.h"
+#include "sqlite3.h"
+
+/**
+ * @file
+ * Registration of C++ callables as SQL functions. Argument and result conversions
+ * are generated from the callable's signature.
+ */
+
+namespace sqliteol {
+namespace internal {
+
+// Signature of a function pointer or of a (non-generic) lambda's call operator.
+template <typename Func>
+struct CallableTraits : CallableTraits<decltype(&Func::operator())> {};
+
+template <typename R, typename... Args>
+struct CallableTraits<R (*)(Args...)> {
+  using Result    = R;
+  using Arguments = std::tuple<std::decay_t<Args>...>;
+};
+
+template <typename C, typename R, typename... Args>
+struct CallableTraits<R (C::*)(Args...)> : CallableTraits<R (*)(Args...)> {};
+
+template <typename C, typename R, typename... Args>
+struct CallableTraits<R (C::*)(Args...) const> : CallableTraits<R (*)(Args...)> {};
+
+template <typename Tuple>
+struct DropFirst;
+
+template <typename First, typename... Rest>
+struct DropFirst<std::tuple<First, Rest...>> {
+  using type = std::tuple<Rest...>;
+};
+
+template <typename T>
+struct IsOptional : std::false_type {};
+
+template <typename T>
+struct IsOptional<std::optional<T>> : std::true_type {};
+
+// Error of a statement whose function threw something other than a std::exception.
+inline constexpr const char* kUnknownError = "SQL function threw an unknown exception";
+
+}  // namespace internal
+
+namespace sqlite3wrap {
+
+inline std::string_view ValueText(sqlite3_value* value) {
+  const unsigned char* text = sqlite3_value_text(value);
+  if (!text) {
+    return {};
+  }
+  return std::string_view(reinterpret_cast<const char*>(text),
+                          static_cast<size_t>(sqlite3_value_bytes(value)));
+}
+
+/*
+ * Converts an SQL function argument to T. Numbers are read natively, strings as
+ * text, std::optional<T> maps NULL to std::nullopt, and other types are parsed with
+ * FromDataBaseString. A string_view points into sqlite's copy of the value and is
+ * only valid during the call.
+ */
+template <typename T>
+T ValueAs(sqlite3_value* value) {
+  if constexpr (internal::IsOptional<T>::value) {
+    if (sqlite3_value_type(value) == SQLITE_NULL) {
+      return std::nullopt;
+    }
+    return ValueAs<typename T::value_type>(value);
+  } else if constexpr (std::integral<T>) {
+    return static_cast<T>(sqlite3_value_int64(value));
+  } else if constexpr (std::floating_point<T>) {
+    return static_cast<T>(sqlite3_value_double(value));
+  } else if constexpr (std::is_same_v<T, std::string_view>) {
+    return ValueText(value);
+  } else if constexpr (std::is_same_v<T, std::string>) {
+    return std::string(ValueText(value));
+  } else {
+    return FromDataBaseString<T>(ValueText(value));
+  }
+}
+
+// Sets the result of an SQL function call from `result`, the inverse of ValueAs.
+template <typename T>
+void SetResult(sqlite3_context* context, const T& result) {
+  if constexpr (internal::IsOptional<T>::value) {
+    if (!result.has_value()) {
+      sqlite3_result_null(context);
+    } else {
+      SetResult(context, *result);
+    }
+  } else if constexpr (std::integral<T>) {
+    sqlite3_result_int64(context, static_cast<sqlite3_int64>(result));
+  } else if constexpr (std::floating_point<T>) {
+    sqlite3_result_double(context, static_cast<double>(result));
+  } else if constexpr (std::is_same_v<T, std::string> ||
+                       std::is_same_v<T, std::string_view>) {
+    sqlite3_result_text64(
+        context, result.data(), result.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+  } else {
+    std::string text = ToDataBaseString(result);
+    sqlite3_result_text64(
+        context, text.data(), text.size(), SQLITE_TRANSIENT, SQLITE_UTF8);
+  }
+}
+
+// Calls `func` with the converted `argv`, arguments in the order of the signature.
+template <typename Arguments, typename Func, typename... Prefix>
+decltype(auto) ApplyValues(Func& func, sqlite3_value** argv, Prefix&... prefix) {
+  return [&]<size_t... I>(std::index_sequence<I...>) -> decltype(auto) {
+    return func(prefix..., ValueAs<std::tuple_element_t<I, Arguments>>(argv[I])...);
+  }(std::make_index_sequence<std::tuple_size_v<Arguments>>());
+}
+
+/*
+ * Registers `func` as the deterministic scalar SQL function `name` on `db`, taking
+ * as many arguments as its signature. Exceptions thrown by `func` fail the
+ * statement with their message; other thrown values with a generic one.
+ */
+template <typename Func>
+void CreateScalarFunction(sqlite3* db,
+                          const std::string& name,
+                          std::shared_ptr<Func> func) {
+  using Traits    = internal::CallableTraits<Func>;
+  using Arguments = typename Traits::Arguments;
+
+  auto call = [](sqlite3_context* context, int, sqlite3_value** argv) {
+    Func& func = **static_cast<std::shared_ptr<Func>*>(sqlite3_user_data(context));
+    try {
+      if constexpr (std::is_void_v<typename Traits::Result>) {
+        ApplyValues<Arguments>(func, argv);
+        sqlite3_result_null(context);
+      } else {
+        SetResult(context, ApplyValues<Arguments>(func, argv));
+      }
+    } catch (const std::exception& e) {
+      sqlite3_result_error(context, e.what(), -1);
+    } catch (...) {
+      sqlite3_result_error(context, internal::kUnknownError, -1);
+    }
+  };
+  auto destroy = [](void* data) { delete static_cast<std::shared_ptr<Func>*>(data); };
+
+  auto* data = new std::shared_ptr<Func>(std::move(func));
+  // sqlite calls `destroy` on the user data also when registration fails.
+  if (sqlite3_create_function_v2(db,
+                                 name.c_str(),
+                                 static_cast<int>(std::tuple_size_v<Arguments>),
+                                 SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                 data,
+                                 call,
+                                 nullptr,
+                                 nullptr,
+                                 destroy) != SQLITE_OK) {
+    throw std::runtime_error(utils::StrCombine(
+        "Failed to register SQL function ", name, ": ", sqlite3_errmsg(db)));
+  }
+}
+
+/**
+ * @struct AggregateFunction
+ * @brief The parts of an aggregate SQL function: every group starts from a copy of
+ *        `initial`, `step(state, args...)` folds in each row and `finalize(state)`
+ *        gives the result. A group without rows yields `finalize(initial)`.
+ */
+template <typename State, typename Step, typename Finalize>
+struct AggregateFunction {
+  State initial;
+  Step step;
+  Finalize finalize;
+};
+
+// Registers `aggregate` as the deterministic aggregate SQL function `name` on `db`.
+template <typename State, typename Step, typename Finalize>
+void CreateAggregateFunction(
+    sqlite3* db,
+    const std::string& name,
+    std::shared_ptr<AggregateFunction<State, Step, Finalize>> aggregate) {
+  using Aggregate = AggregateFunction<State, Step, Finalize>;
+  // The first parameter of `step` is the state.
+  using StepArguments = typename internal::CallableTraits<Step>::Arguments;
+  using Arguments     = typename internal::DropFirst<StepArguments>::type;
+
+  // The aggregate context holds a pointer to the group's state, created on its
+  // first row and deleted by `finalize`.
+  auto step = [](sqlite3_context* context, int, sqlite3_value** argv) {
+    Aggregate& aggregate =
+        **static_cast<std::shared_ptr<Aggregate>*>(sqlite3_user_data(context));
+    auto** state =
+        static_cast<State**>(sqlite3_aggregate_context(context, sizeof(State*)));
+    if (!state) {
+      sqlite3_result_error_nomem(context);
+      return;
+    }
+    try {
+      if (!*state) {
+        *state = new State(aggregate.initial);
+      }
+      ApplyValues<Arguments>(aggregate.step, argv, **state);
+    } catch (const std::exception& e) {
+      sqlite3_result_error(context, e.what(), -1);
+    } catch (...) {
+      sqlite3_result_error(context, internal::kUnknownError, -1);
+    }
+  };
+  auto finalize = [](sqlite3_context* context) {
+    Aggregate& aggregate =
+        **static_cast<std::shared_ptr<Aggregate>*>(sqlite3_user_data(context));
+    auto** state = static_cast<State**>(sqlite3_aggregate_context(context, 0));
+    std::unique_ptr<State> owned(state ? *state : nullptr);
+    try {
+      if (!owned) {
+        // A group without rows; `initial` itself is shared by every group.
+        owned = std::make_unique<State>(aggregate.initial);
+      }
+      SetResult(context, aggregate.finalize(*owned));
+    } catch (const std::exception& e) {
+      sqlite3_result_error(context, e.what(), -1);
+    } catch (...) {
+      sqlite3_result_error(context, internal::kUnknownError, -1);
+    }
+  };
+  auto destroy = [](void* data) {
+    delete static_cast<std::shared_ptr<Aggregate>*>(data);
+  };
+
+  auto* data = new std::shared_ptr<Aggregate>(std::move(aggregate));
+  if (sqlite3_create_function_v2(db,
+                                 name.c_str(),
+                                 static_cast<int>(std::tuple_size_v<Arguments>),
+                                 SQLITE_UTF8 | SQLITE_DETERMINISTIC,
+                                 data,
+                                 nullptr,
+                                 step,
+                                 finalize,
+                                 destroy) != SQLITE_OK) {
+    throw std::runtime_error(utils::StrCombine(
+        "Failed to register SQL aggregate ", name, ": ", sqlite3_errmsg(db)));
+  }
+}
+
+}  // namespace sqlite3wrap
+}  // namespace sqliteol
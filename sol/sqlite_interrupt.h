@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+
+#include "sol/utils/str_utils.h"
+#include "sqlite3.h"
+
+/**
+ * @file
+ * Deadlines and cancellation of library calls, and the retry policy for locked
+ * databases. Running statements are stopped through sqlite's progress handler.
+ */
+
+namespace sqliteol {
+
+enum class InterruptReason {
+  kCancelled,         // The call's CancellationToken was cancelled
+  kDeadlineExceeded,  // The call's deadline passed
+};
+
+/**
+ * @class InterruptedError
+ * @brief Thrown by a call stopped by its ScopedDeadline. A write interrupted inside a
+ *        transaction rolls the whole transaction back.
+ */
+class InterruptedError : public std::runtime_error {
+ public:
+  inline InterruptedError(InterruptReason reason, const std::string& what)
+      : std::runtime_error(what), reason_(reason) {
+  }
+
+  inline InterruptReason reason() const {
+    return reason_;
+  }
+
+ private:
+  InterruptReason reason_;
+};
+
+/**
+ * @class CancellationToken
+ * @brief A flag shared by its copies: Cancel on any copy, for instance from another
+ *        thread, stops the calls made under a ScopedDeadline holding another.
+ */
+class CancellationToken {
+ public:
+  inline CancellationToken() : cancelled_(std::make_shared<std::atomic<bool>>(false)) {
+  }
+
+  inline void Cancel() const {
+    cancelled_->store(true, std::memory_order_release);
+  }
+
+  inline bool IsCancelled() const {
+    return cancelled_->load(std::memory_order_acquire);
+  }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+};
+
+/**
+ * @class ScopedDeadline
+ * @brief Bounds every library call the current thread makes while it is alive.
+ *
+ * @details A call that is still running when the deadline passes or the token is
+ *          cancelled throws InterruptedError: statements are stopped by sqlite's
+ *          progress handler, waits for the writer lock and busy retries give up, and
+ *          calls started afterwards fail right away. Scopes nest; an inner scope
+ *          never extends the deadline of the outer one and both tokens apply.
+ *
+ * Example usage:
+ *   ScopedDeadline deadline(std::chrono::milliseconds(50), request.cancellation);
+ *   auto rows = db_file.GetTable<Event>();
+ */
+class ScopedDeadline {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  inline explicit ScopedDeadline(Clock::time_point deadline,
+                                 std::optional<CancellationToken> token = std::nullopt)
+      : deadline_(deadline), token_(std::move(token)), outer_(current_) {
+    if (outer_) {
+      deadline_ = std::min(deadline_, outer_->deadline_);
+    }
+    current_ = this;
+  }
+
+  inline explicit ScopedDeadline(Clock::duration timeout,
+                                 std::optional<CancellationToken> token = std::nullopt)
+      : ScopedDeadline(Clock::now() + timeout, std::move(token)) {
+  }
+
+  inline explicit ScopedDeadline(CancellationToken token)
+      : ScopedDeadline(Clock::time_point::max(), std::move(token)) {
+  }
+
+  ScopedDeadline(const ScopedDeadline&)            = delete;
+  ScopedDeadline& operator=(const ScopedDeadline&) = delete;
+
+  inline ~ScopedDeadline() {
+    current_ = outer_;
+  }
+
+  inline static bool IsActive() {
+    return current_ != nullptr;
+  }
+
+  // Earliest deadline of the current thread's scopes, if any.
+  inline static std::optional<Clock::time_point> Deadline() {
+    if (!current_ || current_->deadline_ == Clock::time_point::max()) {
+      return std::nullopt;
+    }
+    return current_->deadline_;
+  }
+
+  // Why the current thread's calls must stop, if they must.
+  inline static std::optional<InterruptReason> Expired() {
+    if (!current_) {
+      return std::nullopt;
+    }
+    for (const ScopedDeadline* scope = current_; scope; scope = scope->outer_) {
+      if (scope->token_ && scope->token_->IsCancelled()) {
+        return InterruptReason::kCancelled;
+      }
+    }
+    if (current_->deadline_ != Clock::time_point::max() &&
+        Clock::now() >= current_->deadline_) {
+      return InterruptReason::kDeadlineExceeded;
+    }
+    return std::nullopt;
+  }
+
+  // Throws InterruptedError if the current thread's calls must stop.
+  inline static void ThrowIfExpired() {
+    if (auto reason = Expired()) {
+      throw InterruptedError(*reason, Describe(*reason));
+    }
+  }
+
+  inline static std::string Describe(InterruptReason reason) {
+    return reason == InterruptReason::kCancelled ? "Call cancelled"
+                                                 : "Call deadline exceeded";
+  }
+
+ private:
+  Clock::time_point deadline_;
+  std::optional<CancellationToken> token_;
+  ScopedDeadline* outer_;
+
+  inline static thread_local ScopedDeadline* current_ = nullptr;
+};
+
+/*
+ * How a statement that finds the database locked by another connection retries
+ * before failing with SQLITE_BUSY: it sleeps `initial_backoff`, doubling up to
+ * `max_backoff`, until `timeout` is spent. A zero timeout fails at once. Retries
+ * also stop at the deadline of the calling thread's ScopedDeadline.
+ */
+struct BusyPolicy {
+  std::chrono::milliseconds timeout         = std::chrono::milliseconds(0);
+  std::chrono::milliseconds initial_backoff = std::chrono::milliseconds(1);
+  std::chrono::milliseconds max_backoff     = std::chrono::milliseconds(50);
+
+  // Time slept over the first `retries` retries.
+  inline std::chrono::milliseconds SleptBefore(int retries) const {
+    std::chrono::milliseconds slept(0);
+    for (int i = 0; i < retries && slept < timeout; ++i) {
+      slept += Backoff(i);
+    }
+    return slept;
+  }
+
+  inline std::chrono::milliseconds Backoff(int retry) const {
+    auto backoff = std::max(initial_backoff, std::chrono::milliseconds(1));
+    for (int i = 0; i < retry && backoff < max_backoff; ++i) {
+      backoff *= 2;
+    }
+    return std::min(backoff, std::max(max_backoff, initial_backoff));
+  }
+};
+
+/*
+ * What the busy handler of a connection works with: its policy, and the counter of
+ * the retries it made, which several connections may share.
+ */
+struct BusyHandlerState {
+  BusyPolicy policy;
+  std::shared_ptr<std::atomic<uint64_t>> retries = nullptr;
+};
+
+namespace sqlite3wrap {
+
+// Virtual machine instructions between two checks of the current ScopedDeadline.
+inline constexpr int kInterruptCheckInterval = 1000;
+
+/*
+ * Installs the handlers stopping the statements of `db` at the deadline of the
+ * calling thread's ScopedDeadline, and retrying locked databases per `busy`, which
+ * must outlive `db`.
+ */
+inline void InstallInterruptHandlers(sqlite3* db, const BusyHandlerState* busy) {
+  sqlite3_progress_handler(
+      db,
+      kInterruptCheckInterval,
+      [](void*) { return ScopedDeadline::Expired() ? 1 : 0; },
+      nullptr);
+
+  sqlite3_busy_handler(
+      db,
+      [](void* data, int retries) {
+        const auto& state  = *static_cast<const BusyHandlerState*>(data);
+        const auto& policy = state.policy;
+        auto left          = policy.timeout - policy.SleptBefore(retries);
+        if (left.count() <= 0 || ScopedDeadline::Expired()) {
+          return 0;
+        }
+        auto sleep = std::chrono::duration_cast<ScopedDeadline::Clock::duration>(
+            std::min(policy.Backoff(retries), left));
+        if (auto deadline = ScopedDeadline::Deadline()) {
+          sleep = std::min(sleep, *deadline - ScopedDeadline::Clock::now());
+        }
+        std::this_thread::sleep_for(sleep);
+        if (state.retries) {
+          state.retries->fetch_add(1, std::memory_order_relaxed);
+        }
+        return 1;
+      },
+      const_cast<BusyHandlerState*>(busy));
+}
+
+/*
+ * Throws InterruptedError if the statement that failed with `rc` was stopped by the
+ * calling thread's ScopedDeadline, or interrupted otherwise.
+ */
+inline void ThrowIfInterrupted(int rc, const std::string& error_message) {
+  int primary = rc & 0xff;
+  if (primary != SQLITE_INTERRUPT && primary != SQLITE_BUSY &&
+      primary != SQLITE_LOCKED) {
+    return;
+  }
+  if (auto reason = ScopedDeadline::Expired()) {
+    throw InterruptedError(*reason,
+                           utils::StrCombine(
+                               ScopedDeadline::Describe(*reason), ": ", error_message));
+  }
+  if (primary == SQLITE_INTERRUPT) {
+    throw InterruptedError(InterruptReason::kCancelled, error_message);
+  }
+}
+
+}  // namespace sqlite3wrap
+}  // namespace sqliteol
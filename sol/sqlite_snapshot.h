@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+
+#include "sol/logger.h"
+#include "sol/sqlite_file.h"
+
+namespace sqliteol {
+
+/**
+ * @class PeriodicSnapshot
+ * @brief Periodically backs up a (typically in-memory) SqliteFile to disk.
+ *
+ * @details A background thread calls SqliteFile::BackupTo every `interval`, giving an
+ *          in-memory working set crash-recovery snapshots. Failed snapshots are
+ *          reported through the Logger and retried on the next tick. The source
+ *          SqliteFile must outlive the snapshotter; destroying it stops the thread.
+ */
+class PeriodicSnapshot {
+ public:
+  inline PeriodicSnapshot(const SqliteFile& source,
+                          const std::filesystem::path& destination,
+                          std::chrono::milliseconds interval,
+                          const BackupOptions& options = {})
+      : source_(source),
+        destination_(destination),
+        interval_(interval),
+        options_(options),
+        worker_([this] { Run(); }) {
+  }
+
+  PeriodicSnapshot(const PeriodicSnapshot&)            = delete;
+  PeriodicSnapshot& operator=(const PeriodicSnapshot&) = delete;
+
+  inline ~PeriodicSnapshot() {
+    {
+      std::lock_guard lock(mutex_);
+      stopped_ = true;
+    }
+    cv_.notify_all();
+    worker_.join();
+  }
+
+  // Takes a snapshot right away on the calling thread.
+  inline void SnapshotNow() {
+    std::lock_guard lock(snapshot_mutex_);
+    source_.BackupTo(destination_, options_);
+  }
+
+ private:
+  inline void Run() {
+    std::unique_lock lock(mutex_);
+    while (!cv_.wait_for(lock, interval_, [this] { return stopped_; })) {
+      lock.unlock();
+      try {
+        SnapshotNow();
+      } catch (const std::exception& e) {
+        Logger::getInstance().error(
+            utils::StrCombine("Periodic snapshot failed: ", e.what()));
+      }
+      lock.lock();
+    }
+  }
+
+  const SqliteFile& source_;
+  SqliteFile destination_;
+  std::chrono::milliseconds interval_;
+  BackupOptions options_;
+
+  std::mutex snapshot_mutex_;  // Serializes SnapshotNow with the background thread
+  std::mutex mutex_;
+  std::condition_variable cv_;
+  bool stopped_ = false;
+  std::thread worker_;  // Declared last so it starts after every other member
+};
+
+}  // namespace sqliteol
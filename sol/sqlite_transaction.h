@@ -0,0 +1,176 @@
+#pragma once
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include "sol/logger.h"
+#include "sol/sqlite3wrap.h"
+#include "sol/sqlite_connection.h"
+#include "sol/utils/str_utils.h"
+
+namespace sqliteol {
+
+enum class TransactionMode {
+  kDeferred,   // Locks are taken by the first read or write
+  kImmediate,  // The write lock is taken right away
+  kExclusive,  // Readers on other connections are locked out too (rollback journal)
+};
+
+/**
+ * @class Savepoint
+ * @brief A nested, named rollback point inside a Transaction.
+ *
+ * @details Released on destruction, or rolled back to when the scope is left by an
+ *          exception. Must not outlive the Transaction it was made from.
+ */
+class Savepoint {
+ public:
+  inline Savepoint(sqlite3* db, std::string name)
+      : db_(db), name_(std::move(name)), uncaught_(std::uncaught_exceptions()) {
+    sqlite3wrap::ExecuteSql(db_, utils::StrCombine("SAVEPOINT ", name_, ";"));
+  }
+
+  Savepoint(const Savepoint&)            = delete;
+  Savepoint& operator=(const Savepoint&) = delete;
+
+  inline ~Savepoint() {
+    if (!active_) {
+      return;
+    }
+    try {
+      if (std::uncaught_exceptions() > uncaught_) {
+        Rollback();
+      } else {
+        Release();
+      }
+    } catch (const std::exception& e) {
+      Logger::getInstance().error(
+          utils::StrCombine("Failed to end savepoint ", name_, ": ", e.what()));
+    }
+  }
+
+  // Keeps the changes made since the savepoint as part of the enclosing transaction.
+  inline void Release() {
+    active_ = false;
+    sqlite3wrap::ExecuteSql(db_, utils::StrCombine("RELEASE ", name_, ";"));
+  }
+
+  // Undoes the changes made since the savepoint; the enclosing transaction goes on.
+  inline void Rollback() {
+    active_ = false;
+    sqlite3wrap::ExecuteSql(
+        db_, utils::StrCombine("ROLLBACK TO ", name_, "; RELEASE ", name_, ";"));
+  }
+
+ private:
+  sqlite3* db_;
+  std::string name_;
+  int uncaught_;
+  bool active_ = true;
+};
+
+/**
+ * @class Transaction
+ * @brief RAII transaction spanning several SqliteFile operations.
+ *
+ * @details Obtained from SqliteFile::BeginTransaction. While it is open, every typed
+ *          operation the owning thread makes on that SqliteFile (and its copies) runs
+ *          on the transaction's connection, so they commit or roll back together
+ *          with one fsync. The writer lock is held until the transaction ends, so
+ *          writes from other threads wait; their reads are not blocked. Leaving the
+ *          scope commits, unless it is left by an exception, which rolls back.
+ *          Calling Commit() explicitly is preferred so commit errors surface.
+ *          Only one transaction per thread and database can be open; nest with
+ *          MakeSavepoint.
+ */
+class Transaction {
+ public:
+  inline Transaction(std::shared_ptr<ConnectionPool> pool, TransactionMode mode)
+      : pool_(std::move(pool)),
+        lease_(pool_->AcquireWriter()),
+        uncaught_(std::uncaught_exceptions()) {
+    if (pool_->InTransaction()) {
+      throw std::runtime_error(
+          "A transaction is already open on this thread, use a Savepoint to nest");
+    }
+    sqlite3wrap::ExecuteSql(lease_.get(), BeginSql(mode));
+    pool_->PinTransaction(lease_.connection());
+  }
+
+  Transaction(const Transaction&)            = delete;
+  Transaction& operator=(const Transaction&) = delete;
+
+  inline ~Transaction() {
+    if (!active_) {
+      return;
+    }
+    try {
+      if (std::uncaught_exceptions() > uncaught_) {
+        Rollback();
+      } else {
+        Commit();
+      }
+    } catch (const std::exception& e) {
+      Logger::getInstance().error(
+          utils::StrCombine("Failed to end transaction: ", e.what()));
+    }
+  }
+
+  inline void Commit() {
+    End("COMMIT;");
+  }
+
+  inline void Rollback() {
+    End("ROLLBACK;");
+  }
+
+  inline Savepoint MakeSavepoint() {
+    if (!active_) {
+      throw std::runtime_error("Transaction already ended");
+    }
+    return Savepoint(lease_.get(), utils::StrCombine("sol_savepoint_",
+                                                      std::to_string(next_savepoint_++)));
+  }
+
+ private:
+  static inline std::string BeginSql(TransactionMode mode) {
+    switch (mode) {
+      case TransactionMode::kImmediate:
+        return "BEGIN IMMEDIATE;";
+      case TransactionMode::kExclusive:
+        return "BEGIN EXCLUSIVE;";
+      default:
+        return "BEGIN DEFERRED;";
+    }
+  }
+
+  inline void End(std::string_view sql) {
+    if (!active_) {
+      throw std::runtime_error("Transaction already ended");
+    }
+    active_ = false;
+    pool_->UnpinTransaction();
+    try {
+      sqlite3wrap::ExecuteSql(lease_.get(), std::string(sql));
+    } catch (...) {
+      // A failed COMMIT leaves the transaction open; do not leak it to the next user.
+      if (!sqlite3_get_autocommit(lease_.get())) {
+        sqlite3_exec(lease_.get(), "ROLLBACK;", nullptr, nullptr, nullptr);
+      }
+      lease_.Release();
+      throw;
+    }
+    // Later writes of this thread take the writer lock again.
+    lease_.Release();
+  }
+
+  std::shared_ptr<ConnectionPool> pool_;
+  ConnectionLease lease_;
+  int uncaught_;
+  bool active_        = true;
+  int next_savepoint_ = 0;
+};
+
+}  // namespace sqliteol
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sol/sqlite3wrap.h"
+#include "sqlite3.h"
+
+namespace sqliteol {
+
+// Space used by one table or index, summed over its B-tree pages.
+struct ObjectStorage {
+  std::string name;
+  std::string table_name;  // The table an index belongs to; `name` for tables
+  bool is_index         = false;
+  int64_t pages         = 0;
+  int64_t bytes         = 0;  // pages * page size
+  int64_t payload_bytes = 0;  // Bytes of stored records
+  int64_t unused_bytes  = 0;  // Bytes of the pages holding nothing
+};
+
+/**
+ * @struct StorageStats
+ * @brief Footprint of a database file, in total and per table and index.
+ *
+ * @details Pages on the freelist belong to no object: they were freed (by deletes or
+ *          DropTable) and are reused by later writes, but are only returned to the
+ *          file system by a vacuum.
+ */
+struct StorageStats {
+  int64_t page_size      = 0;
+  int64_t page_count     = 0;
+  int64_t freelist_count = 0;
+  std::vector<ObjectStorage> objects;  // Largest first
+
+  inline int64_t file_bytes() const {
+    return page_size * page_count;
+  }
+
+  inline int64_t free_bytes() const {
+    return page_size * freelist_count;
+  }
+};
+
+namespace sqlite3wrap {
+
+inline int64_t PragmaInt(sqlite3* db, const std::string& pragma) {
+  auto stmt = Prepare(db, utils::StrCombine("PRAGMA ", pragma, ";"));
+  return Step(stmt.get()) ? sqlite3_column_int64(stmt.get(), 0) : 0;
+}
+
+/*
+ * Reads the page counts of `db` and, through the dbstat virtual table, the space of
+ * every table and index of its "main" database. Throws if sqlite was built without
+ * SQLITE_ENABLE_DBSTAT_VTAB.
+ */
+inline StorageStats ReadStorageStats(sqlite3* db) {
+  StorageStats stats;
+  stats.page_size      = PragmaInt(db, "page_size");
+  stats.page_count     = PragmaInt(db, "page_count");
+  stats.freelist_count = PragmaInt(db, "freelist_count");
+
+  auto stmt = Prepare(db,
+                      "SELECT d.name, coalesce(m.tbl_name, d.name), m.type = 'index', "
+                      "d.pageno, d.pgsize, d.payload, d.unused "
+                      "FROM dbstat('main', 1) AS d "
+                      "LEFT JOIN sqlite_master AS m ON m.name = d.name "
+                      "ORDER BY d.pgsize DESC, d.name;");
+  while (Step(stmt.get())) {
+    ObjectStorage object;
+    object.name          = std::string(ColumnText(stmt.get(), 0));
+    object.table_name    = std::string(ColumnText(stmt.get(), 1));
+    object.is_index      = sqlite3_column_int(stmt.get(), 2) != 0;
+    object.pages         = sqlite3_column_int64(stmt.get(), 3);
+    object.bytes         = sqlite3_column_int64(stmt.get(), 4);
+    object.payload_bytes = sqlite3_column_int64(stmt.get(), 5);
+    object.unused_bytes  = sqlite3_column_int64(stmt.get(), 6);
+    stats.objects.push_back(std::move(object));
+  }
+  return stats;
+}
+
+}  // namespace sqlite3wrap
+}  // namespace sqliteol
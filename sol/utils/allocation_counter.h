@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/**
+ * @file
+ * Opt-in counting of heap allocations, for tests that keep allocations per row of
+ * the hot paths in check. Counting needs the global operator new defined by
+ * SOL_DEFINE_COUNTING_ALLOCATOR(), expanded in exactly one translation unit of the
+ * test binary; without it every count stays zero. Only allocations made through
+ * operator new on the counting thread are seen, not sqlite's own mallocs.
+ *
+ * Example usage:
+ *   SOL_DEFINE_COUNTING_ALLOCATOR();
+ *
+ *   AllocationStats stats = CountAllocations([&] { db_file.InsertRows(rows); });
+ *   EXPECT_LE(stats.allocations, 4 * rows.size());
+ */
+
+namespace sqliteol {
+namespace utils {
+
+struct AllocationStats {
+  uint64_t allocations = 0;
+  uint64_t bytes       = 0;
+};
+
+class AllocationScope;
+
+namespace internal {
+
+inline thread_local AllocationScope* active_allocation_scope = nullptr;
+
+}  // namespace internal
+
+/*
+ * Counts the allocations made by the current thread while it lives. Scopes nest;
+ * only the innermost one counts.
+ */
+class AllocationScope {
+ public:
+  inline AllocationScope() : outer_(internal::active_allocation_scope) {
+    internal::active_allocation_scope = this;
+  }
+
+  AllocationScope(const AllocationScope&)            = delete;
+  AllocationScope& operator=(const AllocationScope&) = delete;
+
+  inline ~AllocationScope() {
+    internal::active_allocation_scope = outer_;
+  }
+
+  inline const AllocationStats& stats() const {
+    return stats_;
+  }
+
+  // Called by the counting operator new.
+  static inline void Record(size_t size) {
+    if (AllocationScope* scope = internal::active_allocation_scope) {
+      ++scope->stats_.allocations;
+      scope->stats_.bytes += size;
+    }
+  }
+
+ private:
+  AllocationScope* outer_;
+  AllocationStats stats_;
+};
+
+// Runs `func` and returns the allocations it made on the calling thread.
+template <typename Func>
+AllocationStats CountAllocations(Func&& func) {
+  AllocationScope scope;
+  func();
+  return scope.stats();
+}
+
+}  // namespace utils
+}  // namespace sqliteol
+
+/*
+ * Replaces the global operator new and delete with malloc-based versions that report
+ * to the active AllocationScope, in their plain, sized and over-aligned forms. The
+ * array and nothrow forms default to these, so replacing them is enough.
+ */
+#define SOL_DEFINE_COUNTING_ALLOCATOR()                                     \
+  void* operator new(std::size_t size) {                                    \
+    ::sqliteol::utils::AllocationScope::Record(size);                       \
+    if (void* ptr = std::malloc(size ? size : 1)) {                         \
+      return ptr;                                                           \
+    }                                                                       \
+    throw std::bad_alloc();                                                 \
+  }                                                                         \
+  void* operator new(std::size_t size, std::align_val_t align) {            \
+    ::sqliteol::utils::AllocationScope::Record(size);                       \
+    auto alignment = static_cast<std::size_t>(align);                       \
+    /* aligned_alloc wants a non-zero multiple of the alignment. */         \
+    std::size_t blocks = ((size ? size : 1) + alignment - 1) / alignment;   \
+    if (void* ptr = std::aligned_alloc(alignment, blocks * alignment)) {    \
+      return ptr;                                                           \
+    }                                                                       \
+    throw std::bad_alloc();                                                 \
+  }                                                                         \
+  /* GCC flags the free of what the (inlined) operator new returned. */     \
+  _Pragma("GCC diagnostic push")                                            \
+  _Pragma("GCC diagnostic ignored \"-Wmismatched-new-delete\"")             \
+  void operator delete(void* ptr) noexcept {                                \
+    std::free(ptr);                                                         \
+  }                                                                         \
+  void operator delete(void* ptr, std::size_t) noexcept {                   \
+    std::free(ptr);                                                         \
+  }                                                                         \
+  void operator delete(void* ptr, std::align_val_t) noexcept {              \
+    std::free(ptr);                                                         \
+  }                                                                         \
+  void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { \
+    std::free(ptr);                                                         \
+  }                                                                         \
+  _Pragma("GCC diagnostic pop")                                             \
+  static_assert(true, "Require a trailing semicolon")
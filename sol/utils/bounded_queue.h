@@ -0,0 +1,65 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+namespace sqliteol {
+namespace utils {
+
+/*
+ * Blocking multi-producer multi-consumer FIFO holding at most `capacity` items.
+ * Close() wakes everybody up: Push then fails, Pop drains what is left and then
+ * returns std::nullopt.
+ * @example BoundedQueue<int> queue(8); queue.Push(1); queue.Pop() -> 1
+ */
+template <typename T>
+class BoundedQueue {
+ public:
+  inline explicit BoundedQueue(size_t capacity) : capacity_(capacity ? capacity : 1) {
+  }
+
+  // Blocks while the queue is full. Returns false if the queue was closed.
+  inline bool Push(T item) {
+    std::unique_lock lock(mutex_);
+    not_full_.wait(lock, [this] { return closed_ || items_.size() < capacity_; });
+    if (closed_) {
+      return false;
+    }
+    items_.push_back(std::move(item));
+    not_empty_.notify_one();
+    return true;
+  }
+
+  // Blocks while the queue is empty and open.
+  inline std::optional<T> Pop() {
+    std::unique_lock lock(mutex_);
+    not_empty_.wait(lock, [this] { return closed_ || !items_.empty(); });
+    if (items_.empty()) {
+      return std::nullopt;
+    }
+    T item = std::move(items_.front());
+    items_.pop_front();
+    not_full_.notify_one();
+    return item;
+  }
+
+  inline void Close() {
+    std::lock_guard lock(mutex_);
+    closed_ = true;
+    not_full_.notify_all();
+    not_empty_.notify_all();
+  }
+
+ private:
+  size_t capacity_;
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::deque<T> items_;
+  bool closed_ = false;
+};
+
+}  // namespace utils
+}  // namespace sqliteol
@@ -0,0 +1,49 @@
+#include "sol/utils/bounded_queue.h"
+
+#include <thread>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using namespace sqliteol::utils;
+using namespace testing;
+
+TEST(BoundedQueueTest, PushPopInOrder) {
+  BoundedQueue<int> queue(4);
+  EXPECT_TRUE(queue.Push(1));
+  EXPECT_TRUE(queue.Push(2));
+  EXPECT_EQ(queue.Pop(), 1);
+  EXPECT_EQ(queue.Pop(), 2);
+}
+
+TEST(BoundedQueueTest, CloseDrainsThenStops) {
+  BoundedQueue<int> queue(4);
+  queue.Push(1);
+  queue.Close();
+  EXPECT_FALSE(queue.Push(2));
+  EXPECT_EQ(queue.Pop(), 1);
+  EXPECT_EQ(queue.Pop(), std::nullopt);
+}
+
+TEST(BoundedQueueTest, ProducerBlocksUntilConsumed) {
+  BoundedQueue<int> queue(1);
+  std::thread producer([&] {
+    for (int i = 0; i < 100; ++i) {
+      queue.Push(i);
+    }
+    queue.Close();
+  });
+  std::vector<int> consumed;
+  while (auto item = queue.Pop()) {
+    consumed.push_back(*item);
+  }
+  producer.join();
+  ASSERT_EQ(consumed.size(), 100);
+  EXPECT_EQ(consumed.back(), 99);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "sol/utils/str_utils.h"
+
+namespace sqliteol {
+namespace utils {
+
+/*
+ * Write-only file that collects appends in a buffer of `buffer_size` bytes and hands
+ * it to the kernel in large write(2) calls. The file is created or truncated. Call
+ * Close() to see write errors; the destructor flushes too but swallows them.
+ * @example BufferedFileWriter out("dump.csv"); out.Append("a,b\n"); out.Close();
+ */
+class BufferedFileWriter {
+ public:
+  inline explicit BufferedFileWriter(const std::filesystem::path& path,
+                                     size_t buffer_size = 1 << 20)
+      : path_(path.string()), capacity_(buffer_size ? buffer_size : 1) {
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+      throw std::runtime_error(
+          StrCombine("Failed to open ", path_, ": ", std::strerror(errno)));
+    }
+    buffer_.reserve(capacity_);
+  }
+
+  BufferedFileWriter(const BufferedFileWriter&)            = delete;
+  BufferedFileWriter& operator=(const BufferedFileWriter&) = delete;
+
+  inline ~BufferedFileWriter() {
+    try {
+      Close();
+    } catch (...) {
+    }
+  }
+
+  inline void Append(std::string_view data) {
+    if (buffer_.size() + data.size() > capacity_) {
+      Flush();
+      if (data.size() >= capacity_) {
+        WriteAll(data);
+        return;
+      }
+    }
+    buffer_.append(data);
+  }
+
+  inline void Append(char c) {
+    if (buffer_.size() == capacity_) {
+      Flush();
+    }
+    buffer_ += c;
+  }
+
+  inline void Flush() {
+    WriteAll(buffer_);
+    buffer_.clear();
+  }
+
+  inline void Close() {
+    if (fd_ < 0) {
+      return;
+    }
+    int fd = fd_;
+    fd_    = -1;
+    try {
+      WriteAll(buffer_, fd);
+    } catch (...) {
+      ::close(fd);
+      throw;
+    }
+    buffer_.clear();
+    if (::close(fd) != 0) {
+      throw std::runtime_error(
+          StrCombine("Failed to close ", path_, ": ", std::strerror(errno)));
+    }
+  }
+
+  // Bytes handed to the file so far, buffered ones included.
+  inline size_t size() const {
+    return written_ + buffer_.size();
+  }
+
+ private:
+  inline void WriteAll(std::string_view data) {
+    WriteAll(data, fd_);
+  }
+
+  inline void WriteAll(std::string_view data, int fd) {
+    if (fd < 0 && !data.empty()) {
+      throw std::runtime_error(StrCombine("Write to closed file ", path_));
+    }
+    while (!data.empty()) {
+      ssize_t written = ::write(fd, data.data(), data.size());
+      if (written < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        throw std::runtime_error(
+            StrCombine("Failed to write ", path_, ": ", std::strerror(errno)));
+      }
+      data.remove_prefix(static_cast<size_t>(written));
+      written_ += static_cast<size_t>(written);
+    }
+  }
+
+  std::string path_;
+  size_t capacity_;
+  int fd_         = -1;
+  size_t written_ = 0;
+  std::string buffer_;
+};
+
+}  // namespace utils
+}  // namespace sqliteol
@@ -0,0 +1,49 @@
+#include "sol/utils/buffered_writer.h"
+
+#include <filesystem>
+#include <string>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "sol/utils/mapped_file.h"
+
+using namespace sqliteol::utils;
+using namespace testing;
+
+TEST(BufferedFileWriterTest, WritesAcrossBufferBoundaries) {
+  auto path = std::filesystem::temp_directory_path() / "BufferedFileWriterTest.txt";
+  std::string expected;
+  {
+    BufferedFileWriter out(path, 8);
+    for (int i = 0; i < 100; ++i) {
+      out.Append(std::to_string(i));
+      out.Append(',');
+      expected += std::to_string(i) + ",";
+    }
+    out.Append(std::string(20, 'x'));  // Larger than the buffer
+    expected += std::string(20, 'x');
+    EXPECT_EQ(out.size(), expected.size());
+    out.Close();
+  }
+  EXPECT_EQ(MappedFile(path).data(), expected);
+  std::filesystem::remove(path);
+}
+
+TEST(BufferedFileWriterTest, DestructorFlushes) {
+  auto path = std::filesystem::temp_directory_path() / "BufferedFileWriterTestDtor.txt";
+  {
+    BufferedFileWriter out(path);
+    out.Append("pending");
+  }
+  EXPECT_EQ(MappedFile(path).data(), "pending");
+  std::filesystem::remove(path);
+}
+
+TEST(BufferedFileWriterTest, MissingDirectoryThrows) {
+  EXPECT_THROW(BufferedFileWriter("/nonexistent/dir/file"), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
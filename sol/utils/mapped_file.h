@@ -0,0 +1,71 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include "sol/utils/str_utils.h"
+
+namespace sqliteol {
+namespace utils {
+
+/*
+ * Read-only memory mapping of a whole file, advised for sequential access.
+ * @example MappedFile file("data.csv"); std::string_view data = file.data();
+ */
+class MappedFile {
+ public:
+  inline explicit MappedFile(const std::filesystem::path& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error(
+          StrCombine("Failed to open ", path.string(), ": ", std::strerror(errno)));
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error(
+          StrCombine("Failed to stat ", path.string(), ": ", std::strerror(errno)));
+    }
+    size_ = static_cast<size_t>(st.st_size);
+    if (size_ > 0) {
+      void* addr = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error(
+            StrCombine("Failed to map ", path.string(), ": ", std::strerror(errno)));
+      }
+      ::madvise(addr, size_, MADV_SEQUENTIAL);
+      data_ = static_cast<const char*>(addr);
+    }
+    ::close(fd);  // The mapping stays valid without the descriptor
+  }
+
+  MappedFile(const MappedFile&)            = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  inline ~MappedFile() {
+    if (data_) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+  }
+
+  inline std::string_view data() const {
+    return std::string_view(data_ ? data_ : "", size_);
+  }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_      = 0;
+};
+
+}  // namespace utils
+}  // namespace sqliteol
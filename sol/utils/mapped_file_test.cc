@@ -0,0 +1,39 @@
+#include "sol/utils/mapped_file.h"
+
+#include <filesystem>
+#include <fstream>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using namespace sqliteol::utils;
+using namespace testing;
+
+TEST(MappedFileTest, MapsWholeFile) {
+  auto path = std::filesystem::temp_directory_path() / "MappedFileTest.txt";
+  std::ofstream(path) << "hello\nworld\n";
+  {
+    MappedFile file(path);
+    EXPECT_EQ(file.data(), "hello\nworld\n");
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFileTest, EmptyFile) {
+  auto path = std::filesystem::temp_directory_path() / "MappedFileTestEmpty.txt";
+  std::ofstream{path};
+  {
+    MappedFile file(path);
+    EXPECT_TRUE(file.data().empty());
+  }
+  std::filesystem::remove(path);
+}
+
+TEST(MappedFileTest, MissingFileThrows) {
+  EXPECT_THROW(MappedFile("/nonexistent/MappedFileTest"), std::runtime_error);
+}
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
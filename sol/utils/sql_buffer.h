@@ -0,0 +1,81 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace sqliteol {
+namespace utils {
+
+/*
+ * Borrows the calling thread's SQL text buffer for one statement. The buffer keeps
+ * its capacity between borrows, so building statements stops allocating once it has
+ * grown to the size of the usual statement; buffers grown past `kMaxRetained` are
+ * released on return. A nested borrow on the same thread gets a buffer of its own.
+ * @example SqlBuffer sql; helper.AppendInsertSQL(sql.str()); ExecuteSql(db, sql.str());
+ */
+class SqlBuffer {
+ public:
+  static constexpr size_t kMaxRetained = 1 << 20;
+
+  inline SqlBuffer() {
+    Slot& slot = ThreadSlot();
+    if (!slot.borrowed) {
+      slot.borrowed = true;
+      buffer_       = &slot.buffer;
+    } else {
+      buffer_ = &own_;
+    }
+    buffer_->clear();
+  }
+
+  SqlBuffer(const SqlBuffer&)            = delete;
+  SqlBuffer& operator=(const SqlBuffer&) = delete;
+
+  inline ~SqlBuffer() {
+    if (buffer_ == &own_) {
+      return;
+    }
+    if (buffer_->capacity() > kMaxRetained) {
+      std::string().swap(*buffer_);
+    }
+    ThreadSlot().borrowed = false;
+  }
+
+  inline std::string& str() {
+    return *buffer_;
+  }
+
+ private:
+  struct Slot {
+    std::string buffer;
+    bool borrowed = false;
+  };
+
+  inline static Slot& ThreadSlot() {
+    thread_local Slot slot;
+    return slot;
+  }
+
+  std::string* buffer_ = nullptr;
+  std::string own_;
+};
+
+/*
+ * Appends `value` to `out` as a SQL string literal, doubling embedded quotes.
+ * @example AppendSqlString(out, "it's") appends "'it''s'"
+ */
+inline void AppendSqlString(std::string& out, std::string_view value) {
+  out += '\'';
+  size_t begin = 0;
+  for (size_t quote = value.find('\''); quote != std::string_view::npos;
+       quote        = value.find('\'', begin)) {
+    out.append(value.data() + begin, quote + 1 - begin);
+    out += '\'';
+    begin = quote + 1;
+  }
+  out.append(value.data() + begin, value.size() - begin);
+  out += '\'';
+}
+
+}  // namespace utils
+}  // namespace sqliteol
@@ -0,0 +1,59 @@
+#include "sol/utils/sql_buffer.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace sqliteol {
+namespace utils {
+namespace testing {
+
+TEST(SqlBufferTest, ReusesTheThreadBuffer) {
+  const char* data = nullptr;
+  {
+    SqlBuffer sql;
+    sql.str() = "SELECT 1;";
+    data      = sql.str().data();
+  }
+  SqlBuffer sql;
+  EXPECT_EQ(sql.str(), "");
+  sql.str() += "SELECT 2;";
+  EXPECT_EQ(sql.str().data(), data);
+}
+
+TEST(SqlBufferTest, NestedBorrowGetsItsOwnBuffer) {
+  SqlBuffer outer;
+  outer.str() = "outer";
+  {
+    SqlBuffer inner;
+    inner.str() = "inner";
+    EXPECT_NE(&inner.str(), &outer.str());
+  }
+  EXPECT_EQ(outer.str(), "outer");
+}
+
+TEST(SqlBufferTest, ReleasesLargeBuffers) {
+  {
+    SqlBuffer sql;
+    sql.str().assign(SqlBuffer::kMaxRetained + 1, 'x');
+  }
+  SqlBuffer sql;
+  EXPECT_LE(sql.str().capacity(), SqlBuffer::kMaxRetained);
+}
+
+TEST(SqlBufferTest, AppendSqlStringDoublesQuotes) {
+  std::string out = "VALUES( ";
+  AppendSqlString(out, "it's 'quoted'");
+  EXPECT_EQ(out, "VALUES( 'it''s ''quoted'''");
+  out.clear();
+  AppendSqlString(out, "");
+  EXPECT_EQ(out, "''");
+}
+
+}  // namespace testing
+}  // namespace utils
+}  // namespace sqliteol
+
+int main(int argc, char** argv) {
+  ::testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
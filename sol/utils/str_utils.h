@@ -1,51 +1,144 @@
 
 #pragma once
 
+#include <cstdint>
 #include <ranges>
 #include <sstream>
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <utility>
 
 namespace sqliteol {
 namespace utils {
 
+/*
+ * Appends all `args` to `out`, growing it at most once.
+ * @example StrAppend(sql, "DROP TABLE ", name, ";")
+ */
+template <typename... Args>
+void StrAppend(std::string& out, Args&&... args) {
+  static_assert((... && std::is_convertible_v<Args, std::string_view>),
+                "All arguments must be convertible to std::string_view.");
+  auto StrAppendImpl = [&out](auto&&... views) {
+    out.reserve(out.size() + (0 + ... + views.size()));
+    ((out += views), ...);
+  };
+  StrAppendImpl(std::string_view(args)...);
+}
+
+/*
+ * Use this function to combine multiple strings into a single string.
+ * @example StrCombine("Hello", " ", "World") -> "Hello World"
+ */
+template <typename... Args>
+std::string StrCombine(Args&&... args) {
+  std::string result;
+  StrAppend(result, std::forward<Args>(args)...);
+  return result;
+}
+
+/*
+ * Appends the elements of `range` to `out`, separated by `separator`. Elements
+ * convertible to std::string_view are copied in with a single reservation; others
+ * are formatted with operator<<.
+ * @example StrJoinTo(out, ", ", {"a", "b"}) appends "a, b"
+ */
+template <std::ranges::input_range Range>
+void StrJoinTo(std::string& out, std::string_view separator, const Range& range) {
+  using Element = std::ranges::range_reference_t<const Range>;
+  if constexpr (std::is_convertible_v<Element, std::string_view>) {
+    if constexpr (std::ranges::forward_range<Range>) {
+      size_t size  = 0;
+      size_t count = 0;
+      for (std::string_view element : range) {
+        size += element.size();
+        ++count;
+      }
+      out.reserve(out.size() + size + (count > 0 ? count - 1 : 0) * separator.size());
+    }
+    bool first = true;
+    for (std::string_view element : range) {
+      if (!first) {
+        out += separator;
+      }
+      out += element;
+      first = false;
+    }
+  } else {
+    std::ostringstream result;
+    bool first = true;
+    for (const auto& element : range) {
+      if (!first) {
+        result << separator;
+      }
+      result << element;
+      first = false;
+    }
+    out += result.str();
+  }
+}
+
 /*
  * use this function to join strings with a separator
  * @example StrJoin(", ", {"a", "b", "c"}) -> "a, b, c"
  */
 template <std::ranges::input_range Range>
 std::string StrJoin(std::string_view separator, const Range& range) {
-  std::ostringstream result;
-  auto iter      = std::ranges::begin(range);
-  const auto end = std::ranges::end(range);
-
-  if (iter != end) {
-    result << *iter++;
-  }
+  std::string result;
+  StrJoinTo(result, separator, range);
+  return result;
+}
 
-  while (iter != end) {
-    result << separator << *iter++;
+/*
+ * Appends `value` to `out` as a quoted JSON string.
+ * @example AppendJsonString(out, "a\"b") appends "\"a\\\"b\""
+ */
+inline void AppendJsonString(std::string& out, std::string_view value) {
+  static constexpr char kHex[] = "0123456789abcdef";
+  out += '"';
+  for (char c : value) {
+    switch (c) {
+      case '"':
+        out += "\\\"";
+        break;
+      case '\\':
+        out += "\\\\";
+        break;
+      case '\n':
+        out += "\\n";
+        break;
+      case '\r':
+        out += "\\r";
+        break;
+      case '\t':
+        out += "\\t";
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          out += "\\u00";
+          out += kHex[(c >> 4) & 0xf];
+          out += kHex[c & 0xf];
+        } else {
+          out += c;
+        }
+    }
   }
-
-  return result.str();
+  out += '"';
 }
 
 /*
- * Use this function to combine multiple strings into a single string.
- * @example StrCombine("Hello", " ", "World") -> "Hello World"
+ * 64-bit FNV-1a hash of `value`, continuing from `seed` so that several strings can
+ * be hashed in sequence. Stable across runs and platforms.
+ * @example Fnv1a64("b", Fnv1a64("a")) == Fnv1a64("ab")
  */
-template <typename... Args>
-std::string StrCombine(Args&&... args) {
-  static_assert((... && std::is_convertible_v<Args, std::string_view>),
-                "All arguments must be convertible to std::string_view.");
-  auto StrCombineImpl = [](auto&&... views) {
-    std::string result;
-    result.reserve((0 + ... + views.size()));
-    ((result += views), ...);
-    return result;
-  };
-  return StrCombineImpl(std::string_view(args)...);
+inline uint64_t Fnv1a64(std::string_view value, uint64_t seed = 0xcbf29ce484222325ULL) {
+  uint64_t hash = seed;
+  for (char c : value) {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
 }
 
 }  // namespace utils
@@ -39,6 +39,18 @@ TEST_F(StrUtilsTest, JoinsWithEmptySeparator) {
   EXPECT_EQ(StrJoin("", v), "abc");
 }
 
+TEST_F(StrUtilsTest, JoinsNonStringElements) {
+  std::vector<int> v = {1, 2, 3};
+  EXPECT_EQ(StrJoin(", ", v), "1, 2, 3");
+}
+
+TEST_F(StrUtilsTest, JoinToAppends) {
+  std::string out            = "( ";
+  std::vector<std::string> v = {"a", "b"};
+  StrJoinTo(out, ", ", v);
+  EXPECT_EQ(out, "( a, b");
+}
+
 // Test cases for StrCombine
 TEST_F(StrUtilsTest, CombinesMultipleStrings) {
   EXPECT_EQ(StrCombine("Hello", " ", "World"), "Hello World");
@@ -56,6 +68,18 @@ TEST_F(StrUtilsTest, CombinesNoStrings) {
   EXPECT_EQ(StrCombine(), "");
 }
 
+TEST_F(StrUtilsTest, AppendsToExistingString) {
+  std::string out = "DROP TABLE ";
+  StrAppend(out, "\"t\"", ";");
+  EXPECT_EQ(out, "DROP TABLE \"t\";");
+}
+
+TEST_F(StrUtilsTest, Fnv1a64ChainsAcrossStrings) {
+  EXPECT_EQ(Fnv1a64(""), 0xcbf29ce484222325ULL);
+  EXPECT_EQ(Fnv1a64("a"), 0xaf63dc4c8601ec8cULL);
+  EXPECT_EQ(Fnv1a64("b", Fnv1a64("a")), Fnv1a64("ab"));
+}
+
 }  // namespace testing
 }  // namespace utils
 }  // namespace sqliteol